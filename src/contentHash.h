@@ -0,0 +1,46 @@
+#pragma once
+// contentHash.h
+// Fast 64-bit hash of a file's contents, shared by the cooked mesh cache and
+// the texture cache to tell whether a file changed.
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "mappedFile.h"
+
+// Fast 64-bit content hash (four multiply-rotate lanes over 8-byte words)
+inline uint64_t contentHashBytes(const void *data, size_t size)
+{
+    const uint64_t prime1 = 0x9E3779B185EBCA87ull, prime2 = 0xC2B2AE3D27D4EB4Full;
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (int l = 0; l < 4; l++)
+        {
+            uint64_t word;
+            memcpy(&word, p + i + l * 8, 8);
+            lanes[l] += word * prime2;
+            lanes[l] = (lanes[l] << 31) | (lanes[l] >> 33);
+            lanes[l] *= prime1;
+        }
+    }
+    uint64_t h = size;
+    for (int l = 0; l < 4; l++)
+        h = (h ^ lanes[l]) * prime1 + prime2;
+    for (; i < size; i++)
+        h = (h ^ p[i]) * prime1;
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    return h;
+}
+
+inline bool contentHashFile(const std::string &path, uint64_t &hash)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+    hash = contentHashBytes(file.data(), file.size());
+    return true;
+}
@@ -0,0 +1,414 @@
+#pragma once
+// grassField.h
+// Scatters many copies of one ObjLoader mesh over the ground and draws them.
+// Per-instance placement (position, scale, yaw, tint) lives in one buffer;
+// every frame the instances are bucketed by LOD and each bucket is a single
+// glDrawElementsInstancedARB call per material of the mesh. The vertex
+// shader redoes the scene's one-light fixed-function lighting
+// (meshProgram.h) so the field matches the lit plant; quantized meshes are
+// decoded in the same shader.
+//
+// Without GL 2.0 + ARB_instanced_arrays + ARB_draw_instanced (old drivers,
+// llvmpipe compatibility profiles) the same LOD buckets are drawn through the
+// fixed-function pipeline from the mesh's float vertices: up to 256 instances
+// at a time are transformed on the CPU into a reused client array, and each
+// such chunk is one glDrawElements per material of its LOD.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "objLoader.h"
+#include "meshProgram.h"
+
+struct GrassInstance
+{
+    float x, y, z, scale;
+    float yaw; // radians
+    float r, g, b;
+};
+
+struct GrassFieldStats
+{
+    size_t instances = 0;  // instances submitted this frame (all passes)
+    size_t drawCalls = 0;  // draw calls this frame (all passes)
+    double instancesPerSecond = 0.0;
+    bool instanced = false;
+};
+
+class GrassField
+{
+public:
+    // `count` instances over [-extent, extent] on the plane y = groundY
+    GrassField(ObjLoader* mesh, int count, float extent, float groundY, float minScale, float maxScale, unsigned seed = 1)
+        : mesh(mesh) {
+        mt19937 random(seed); // the placement's own, so rand() users are unaffected
+        instances.resize(count);
+        for (int i = 0; i < count; i++) {
+            GrassInstance& g = instances[i];
+            g.x = (randomUnit(random) * 2.0f - 1.0f) * extent;
+            g.z = (randomUnit(random) * 2.0f - 1.0f) * extent;
+            g.y = groundY;
+            g.scale = minScale + (maxScale - minScale) * randomUnit(random);
+            g.yaw = randomUnit(random) * 6.2831853f;
+            // Slight per-plant colour variation around white
+            float shade = 0.75f + 0.25f * randomUnit(random);
+            g.r = shade * (0.85f + 0.15f * randomUnit(random));
+            g.g = shade;
+            g.b = shade * (0.8f + 0.2f * randomUnit(random));
+        }
+        statsStart = chrono::steady_clock::now();
+    }
+    ~GrassField() {
+        release();
+    }
+
+    // Draw every instance; shadowMode as for ObjLoader::draw
+    void draw(int shadowMode) {
+        if (instances.empty() || !mesh->prepare()) {
+            return;
+        }
+        if (!setupDone) {
+            setup();
+        }
+        bucketByLod();
+        if (shadowMode == 0) {
+            mesh->init(); // bind the texture
+        }
+        if (shader.program != 0) {
+            mesh->bindMeshArrays();
+            drawInstanced(shadowMode);
+            mesh->unbindMeshArrays();
+        }
+        else {
+            drawFallback(shadowMode);
+        }
+    }
+
+    // Call once per frame after the swap; prints throughput every few seconds
+    void endFrame() {
+        lastFrame.instances = frameInstances;
+        lastFrame.drawCalls = frameDrawCalls;
+        lastFrame.instanced = shader.program != 0;
+        windowInstances += frameInstances;
+        windowFrames++;
+        frameInstances = frameDrawCalls = 0;
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - statsStart).count();
+        if (seconds >= 2.0) {
+            lastFrame.instancesPerSecond = windowInstances / seconds;
+            printf("GrassField: %zu instances, %.0f instances/s, %.1f fps, %zu draw calls/frame (%s)\n",
+                instances.size(), lastFrame.instancesPerSecond, windowFrames / seconds, lastFrame.drawCalls,
+                lastFrame.instanced ? "instanced" : "fallback");
+            windowInstances = 0;
+            windowFrames = 0;
+            statsStart = chrono::steady_clock::now();
+        }
+    }
+
+    const GrassFieldStats& stats() const {
+        return lastFrame;
+    }
+
+    void release() {
+        if (shader.program != 0) {
+            meshProgramDelete(shader);
+            glDeleteBuffers(1, &instanceBuffer);
+        }
+        instanceBuffer = 0;
+        setupDone = false;
+    }
+
+    void setForceFallback(bool force) {
+        release();
+        forceFallback = force;
+    }
+
+private:
+    ObjLoader* mesh;
+    vector<GrassInstance> instances;
+    vector<GrassInstance> sorted;   // instances grouped by LOD, rebuilt per pass
+    vector<unsigned char> lodOf;
+    vector<int> lodStart, lodCount;
+    MeshProgram shader; // instanced variant, program 0 when falling back
+    GLuint instanceBuffer = 0;
+    bool setupDone = false;
+    bool forceFallback = false;
+    GrassFieldStats lastFrame;
+    size_t frameInstances = 0, frameDrawCalls = 0;
+    size_t windowInstances = 0, windowFrames = 0;
+    chrono::steady_clock::time_point statsStart;
+
+    // Fallback: a LOD's vertices as a compact list, and its subsets' indices
+    // renumbered into it and repeated once per chunk slot, each copy offset
+    // by one instance's worth of vertices
+    struct FallbackLevel {
+        vector<uint32_t> vertices;  // mesh vertex behind each compact vertex
+        vector<uint32_t> indices;   // subset after subset, `chunk` copies of each
+        vector<size_t> subsetStart; // into a single copy, subsetCount() + 1 entries
+        int chunk = 1;              // instances per draw call
+    };
+    struct FallbackVertex {
+        float px, py, pz;
+        float u, v;
+        float nx, ny, nz;
+        GLubyte color[4];
+    };
+    vector<FallbackLevel> fallbackLevels;
+    const MeshVertex* fallbackSource = NULL; // vertexData() the levels were built from
+    vector<FallbackVertex> fallbackStream;
+
+    // [0, 1) from the top 24 bits, the same on every platform
+    static float randomUnit(mt19937& random) {
+        return (float)(random() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    void setup() {
+        setupDone = true;
+        if (forceFallback || !GLEE_VERSION_2_0 || !GLEE_ARB_instanced_arrays || !GLEE_ARB_draw_instanced ||
+            !GLEE_VERSION_1_5) {
+            printf("GrassField: no hardware instancing, using the batched fallback\n");
+            return;
+        }
+        unsigned variant = MESH_PROGRAM_INSTANCED | (mesh->quantizedDraw() ? MESH_PROGRAM_QUANTIZED : 0);
+        if (!meshProgramCreate(shader, variant, "GrassField")) {
+            printf("GrassField: no instancing shader, using the batched fallback\n");
+            return;
+        }
+        glGenBuffers(1, &instanceBuffer);
+    }
+
+    // Counting sort of the instances by the LOD their projected size asks for
+    void bucketByLod() {
+        GLfloat modelview[16], projection[16];
+        GLint viewport[4];
+        glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+        glGetFloatv(GL_PROJECTION_MATRIX, projection);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        float viewScale = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            float s = sqrtf(modelview[c * 4] * modelview[c * 4] + modelview[c * 4 + 1] * modelview[c * 4 + 1] +
+                modelview[c * 4 + 2] * modelview[c * 4 + 2]);
+            viewScale = s > viewScale ? s : viewScale;
+        }
+        // Placement scales the mesh sphere by localMatrix's scale (1: rotate
+        // + translate only) and the instance scale
+        float pixelsPerRadius = mesh->bounds().radius * viewScale * projection[5] * viewport[3];
+        bool perspective = projection[11] != 0.0f;
+
+        int levels = mesh->lodCount();
+        lodStart.assign(levels + 1, 0);
+        lodCount.assign(levels, 0);
+        lodOf.resize(instances.size());
+        for (size_t i = 0; i < instances.size(); i++) {
+            const GrassInstance& g = instances[i];
+            float pixels = pixelsPerRadius * g.scale;
+            if (perspective) {
+                float distance = -(modelview[2] * g.x + modelview[6] * g.y + modelview[10] * g.z + modelview[14]);
+                pixels = distance > 1e-3f ? pixels / distance : 1e9f;
+            }
+            int lod = mesh->lodForPixels(pixels);
+            lodOf[i] = (unsigned char)lod;
+            lodCount[lod]++;
+        }
+        for (int l = 0; l < levels; l++) {
+            lodStart[l + 1] = lodStart[l] + lodCount[l];
+        }
+        sorted.resize(instances.size());
+        vector<int> fill(lodStart.begin(), lodStart.end() - 1);
+        for (size_t i = 0; i < instances.size(); i++) {
+            sorted[fill[lodOf[i]]++] = instances[i];
+        }
+    }
+
+    void drawInstanced(int shadowMode) {
+        // Orphan and refill: the driver can keep the previous pass' copy in flight
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sorted.size() * sizeof(GrassInstance), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sorted.size() * sizeof(GrassInstance), sorted.data());
+
+        GLfloat local[16];
+        mesh->localMatrix(local);
+        meshProgramBegin(shader, shadowMode, &mesh->quantization());
+        glUniformMatrix4fv(shader.localMatrix, 1, GL_FALSE, local);
+        glEnableVertexAttribArray(MESH_INSTANCE_OFFSET_SCALE_ATTRIB);
+        glEnableVertexAttribArray(MESH_INSTANCE_YAW_COLOR_ATTRIB);
+        glVertexAttribDivisorARB(MESH_INSTANCE_OFFSET_SCALE_ATTRIB, 1);
+        glVertexAttribDivisorARB(MESH_INSTANCE_YAW_COLOR_ATTRIB, 1);
+
+        for (int l = 0; l < (int)lodCount.size(); l++) {
+            if (lodCount[l] == 0) {
+                continue;
+            }
+            // The bucket's first instance is the attribute base
+            const char* base = (const char*)(lodStart[l] * sizeof(GrassInstance));
+            glVertexAttribPointer(MESH_INSTANCE_OFFSET_SCALE_ATTRIB, 4, GL_FLOAT, GL_FALSE, sizeof(GrassInstance), base);
+            glVertexAttribPointer(MESH_INSTANCE_YAW_COLOR_ATTRIB, 4, GL_FLOAT, GL_FALSE, sizeof(GrassInstance), base + 4 * sizeof(float));
+            for (int s = 0; s < mesh->subsetCount(); s++) {
+                GLsizei count = mesh->subsetIndexCount(l, s);
+                if (count == 0) {
+                    continue;
+                }
+                if (shadowMode == 0) {
+                    mesh->bindSubsetTexture(l, s);
+                }
+                glDrawElementsInstancedARB(GL_TRIANGLES, count, GL_UNSIGNED_INT, mesh->subsetIndexPointer(l, s), lodCount[l]);
+                frameDrawCalls++;
+            }
+        }
+        frameInstances += sorted.size();
+
+        glVertexAttribDivisorARB(MESH_INSTANCE_OFFSET_SCALE_ATTRIB, 0);
+        glVertexAttribDivisorARB(MESH_INSTANCE_YAW_COLOR_ATTRIB, 0);
+        glDisableVertexAttribArray(MESH_INSTANCE_OFFSET_SCALE_ATTRIB);
+        glDisableVertexAttribArray(MESH_INSTANCE_YAW_COLOR_ATTRIB);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        meshProgramEnd();
+    }
+
+    // Up to 256 instances per chunk, fewer where that many copies of a
+    // level would pass 64K vertices. Rebuilt when a reload swaps the mesh.
+    void buildFallbackLevels() {
+        const vector<MeshVertex>& source = mesh->vertexData();
+        fallbackSource = source.data();
+        fallbackLevels.assign(mesh->lodCount(), FallbackLevel());
+        vector<uint32_t> remap(source.size(), UINT32_MAX);
+        vector<uint32_t> single;
+        for (int l = 0; l < (int)fallbackLevels.size(); l++) {
+            FallbackLevel& level = fallbackLevels[l];
+            single.clear();
+            level.subsetStart.assign(1, 0);
+            for (int s = 0; s < mesh->subsetCount(); s++) {
+                const uint32_t* indices = mesh->subsetIndexData(l, s);
+                GLsizei count = mesh->subsetIndexCount(l, s);
+                for (GLsizei i = 0; i < count; i++) {
+                    uint32_t& compact = remap[indices[i]];
+                    if (compact == UINT32_MAX) {
+                        compact = (uint32_t)level.vertices.size();
+                        level.vertices.push_back(indices[i]);
+                    }
+                    single.push_back(compact);
+                }
+                level.subsetStart.push_back(single.size());
+            }
+            for (size_t i = 0; i < level.vertices.size(); i++) {
+                remap[level.vertices[i]] = UINT32_MAX;
+            }
+            size_t vertexCount = max<size_t>(level.vertices.size(), 1);
+            level.chunk = (int)min<size_t>(256, max<size_t>(1, 65536 / vertexCount));
+            level.indices.resize(single.size() * level.chunk);
+            uint32_t* out = level.indices.data();
+            for (int s = 0; s < mesh->subsetCount(); s++) {
+                for (int k = 0; k < level.chunk; k++) {
+                    uint32_t offset = (uint32_t)(k * level.vertices.size());
+                    for (size_t i = level.subsetStart[s]; i < level.subsetStart[s + 1]; i++) {
+                        *out++ = single[i] + offset;
+                    }
+                }
+            }
+        }
+    }
+
+    // One instance's copy of a level, placed as the old per-instance matrix
+    // did: translate * yaw * scale * local. Normals take the rotations only.
+    static void transformInstance(const GrassInstance& g, const GLfloat local[16], const GLubyte color[4],
+        const FallbackLevel& level, const MeshVertex* source, FallbackVertex* out) {
+        float c = cosf(g.yaw), s = sinf(g.yaw);
+        float n[9], t[3]; // yaw * local, column-major 3x3, and the translation
+        for (int col = 0; col < 4; col++) {
+            float x = local[col * 4], y = local[col * 4 + 1], z = local[col * 4 + 2];
+            float* dst = col < 3 ? n + col * 3 : t;
+            dst[0] = c * x + s * z;
+            dst[1] = y;
+            dst[2] = c * z - s * x;
+        }
+        float m[9];
+        for (int i = 0; i < 9; i++) {
+            m[i] = n[i] * g.scale;
+        }
+        float tx = g.x + t[0] * g.scale, ty = g.y + t[1] * g.scale, tz = g.z + t[2] * g.scale;
+        for (size_t i = 0; i < level.vertices.size(); i++) {
+            const MeshVertex& v = source[level.vertices[i]];
+            FallbackVertex& o = out[i];
+            o.px = m[0] * v.px + m[3] * v.py + m[6] * v.pz + tx;
+            o.py = m[1] * v.px + m[4] * v.py + m[7] * v.pz + ty;
+            o.pz = m[2] * v.px + m[5] * v.py + m[8] * v.pz + tz;
+            o.u = v.u;
+            o.v = v.v;
+            o.nx = n[0] * v.nx + n[3] * v.ny + n[6] * v.nz;
+            o.ny = n[1] * v.nx + n[4] * v.ny + n[7] * v.nz;
+            o.nz = n[2] * v.nx + n[5] * v.ny + n[8] * v.nz;
+            memcpy(o.color, color, 4);
+        }
+    }
+
+    void drawFallback(int shadowMode) {
+        if (fallbackSource != mesh->vertexData().data() || (int)fallbackLevels.size() != mesh->lodCount()) {
+            buildFallbackLevels();
+        }
+        GLfloat local[16];
+        mesh->localMatrix(local);
+        GLfloat color[4];
+        glGetFloatv(GL_CURRENT_COLOR, color);
+        if (GLEE_VERSION_1_5) {
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        if (shadowMode == 0) {
+            glEnableClientState(GL_COLOR_ARRAY);
+        }
+        const MeshVertex* source = mesh->vertexData().data();
+        for (int l = 0; l < (int)lodCount.size(); l++) {
+            const FallbackLevel& level = fallbackLevels[l];
+            size_t vertexCount = level.vertices.size();
+            if (lodCount[l] == 0 || vertexCount == 0) {
+                continue;
+            }
+            if (fallbackStream.size() < vertexCount * level.chunk) {
+                fallbackStream.resize(vertexCount * level.chunk);
+            }
+            const FallbackVertex* stream = fallbackStream.data();
+            GLsizei stride = sizeof(FallbackVertex);
+            glVertexPointer(3, GL_FLOAT, stride, &stream->px);
+            glTexCoordPointer(2, GL_FLOAT, stride, &stream->u);
+            glNormalPointer(GL_FLOAT, stride, &stream->nx);
+            glColorPointer(4, GL_UNSIGNED_BYTE, stride, stream->color);
+            for (int first = lodStart[l]; first < lodStart[l + 1]; first += level.chunk) {
+                int chunk = min(level.chunk, lodStart[l + 1] - first);
+                for (int i = 0; i < chunk; i++) {
+                    const GrassInstance& g = sorted[first + i];
+                    float tint[4] = { color[0] * g.r, color[1] * g.g, color[2] * g.b, color[3] };
+                    GLubyte rgba[4];
+                    for (int c = 0; c < 4; c++) {
+                        rgba[c] = (GLubyte)(min(max(tint[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+                    }
+                    transformInstance(g, local, rgba, level, source, &fallbackStream[i * vertexCount]);
+                }
+                for (int s = 0; s < mesh->subsetCount(); s++) {
+                    size_t count = level.subsetStart[s + 1] - level.subsetStart[s];
+                    if (count == 0) {
+                        continue;
+                    }
+                    if (shadowMode == 0) {
+                        mesh->bindSubsetTexture(l, s);
+                    }
+                    glDrawElements(GL_TRIANGLES, (GLsizei)(count * chunk), GL_UNSIGNED_INT,
+                        level.indices.data() + level.chunk * level.subsetStart[s]);
+                    frameDrawCalls++;
+                }
+            }
+        }
+        frameInstances += sorted.size();
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glColor4fv(color);
+    }
+};
@@ -0,0 +1,306 @@
+#pragma once
+// hotReload.h
+// The two halves of ObjLoader's hot reload that need no GL: a watcher
+// thread that reports when any of a set of files has been written, and a
+// block diff that finds which byte ranges of a rebuilt buffer differ from the
+// resident one, so only those are re-uploaded.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Buffer diff
+
+struct BufferRange
+{
+    size_t offset; // bytes
+    size_t size;
+};
+
+// How to bring a resident buffer up to date with new contents
+struct BufferDelta
+{
+    bool full = true;                // size changed (or nothing resident): upload everything
+    std::vector<BufferRange> ranges; // otherwise the changed ranges, in order
+    size_t bytes = 0;                // new buffer size
+
+    size_t uploadBytes() const
+    {
+        if (full)
+            return bytes;
+        size_t total = 0;
+        for (size_t i = 0; i < ranges.size(); i++)
+            total += ranges[i].size;
+        return total;
+    }
+};
+
+// Append the ranges in which two buffers of `bytes` bytes differ, compared
+// block by block, offset by `base`. Changed blocks closer than `gap` bytes
+// share a range, since one larger glBufferSubData beats several small ones.
+inline void meshDiffRanges(const void *oldData, const void *newData, size_t bytes, size_t base, std::vector<BufferRange> &out,
+                           size_t block = 256, size_t gap = 4096)
+{
+    const char *a = (const char *)oldData;
+    const char *b = (const char *)newData;
+    size_t first = out.size();
+    for (size_t offset = 0; offset < bytes; offset += block)
+    {
+        size_t size = bytes - offset < block ? bytes - offset : block;
+        if (memcmp(a + offset, b + offset, size) == 0)
+            continue;
+        if (out.size() > first && base + offset <= out.back().offset + out.back().size + gap)
+            out.back().size = base + offset + size - out.back().offset;
+        else
+            out.push_back(BufferRange{base + offset, size});
+    }
+}
+
+// The delta for one buffer made of consecutive parts (the index buffer holds
+// the full mesh, then the LOD chain): parts are diffed separately, so no
+// range straddles two CPU arrays
+inline BufferDelta meshDiffBuffer(const std::vector<std::pair<const void *, size_t>> &oldParts,
+                                  const std::vector<std::pair<const void *, size_t>> &newParts)
+{
+    BufferDelta delta;
+    bool sameLayout = oldParts.size() == newParts.size();
+    for (size_t i = 0; i < newParts.size(); i++)
+    {
+        delta.bytes += newParts[i].second;
+        sameLayout = sameLayout && oldParts[i].second == newParts[i].second;
+    }
+    if (!sameLayout || delta.bytes == 0)
+        return delta;
+    delta.full = false;
+    size_t base = 0;
+    for (size_t i = 0; i < newParts.size(); i++)
+    {
+        meshDiffRanges(oldParts[i].first, newParts[i].first, newParts[i].second, base, delta.ranges);
+        base += newParts[i].second;
+    }
+    // Scattered edits everywhere: one upload is cheaper than hundreds
+    if (delta.ranges.size() > 256)
+        delta.full = true;
+    return delta;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// File watcher
+
+// Watches the directories of a set of files on a thread of its own (inotify
+// on Linux, change notifications on Windows) and calls back once a watched
+// file has been written and then left alone for settleMs, so editors that
+// save in several steps cause one reload. Watching directories rather than
+// the files keeps working across save-by-rename. The callback runs on the
+// watcher thread and gets the time of the first write of the burst.
+class FileWatcher
+{
+public:
+    typedef std::function<void(std::chrono::steady_clock::time_point firstChange)> Callback;
+
+    FileWatcher() {}
+    ~FileWatcher() { stop(); }
+
+    // Replaces any previous watch. Returns false if no file could be watched.
+    bool start(const std::vector<std::string> &paths, Callback callback, int settleMs = 50)
+    {
+        stop();
+        files.clear();
+        dirs.clear();
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            if (paths[i].empty())
+                continue;
+            size_t slash = paths[i].find_last_of("/\\");
+            WatchedFile file;
+            file.dir = slash == std::string::npos ? "." : paths[i].substr(0, slash);
+            file.name = slash == std::string::npos ? paths[i] : paths[i].substr(slash + 1);
+            file.path = paths[i];
+            file.stamp = fileStamp(paths[i]);
+            files.push_back(file);
+            bool known = false;
+            for (size_t d = 0; d < dirs.size() && !known; d++)
+                known = dirs[d] == file.dir;
+            if (!known)
+                dirs.push_back(file.dir);
+        }
+        if (!openWatches())
+        {
+            closeWatches();
+            return false;
+        }
+        this->callback = callback;
+        this->settleMs = settleMs;
+        stopping = false;
+        worker = std::thread([this]() { run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        stopping = true;
+        if (worker.joinable())
+            worker.join();
+        closeWatches();
+    }
+
+    bool watching() const { return worker.joinable(); }
+
+private:
+    struct WatchedFile
+    {
+        std::string path, dir, name;
+        uint64_t stamp; // Windows: write time and size, to tell which file a directory change was
+    };
+
+    std::vector<WatchedFile> files;
+    std::vector<std::string> dirs;
+    Callback callback;
+    int settleMs = 50;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+#ifdef _WIN32
+    std::vector<HANDLE> handles; // one per dirs[]
+#else
+    int fd = -1;
+    std::vector<int> descriptors; // one per dirs[]
+#endif
+
+    void run()
+    {
+        typedef std::chrono::steady_clock Clock;
+        bool pending = false;
+        Clock::time_point firstChange, lastChange;
+        while (!stopping)
+        {
+            int timeout = 100; // ms; also how quickly stop() is noticed
+            if (pending)
+            {
+                int quiet = (int)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - lastChange).count();
+                if (quiet >= settleMs)
+                {
+                    pending = false;
+                    callback(firstChange);
+                    continue;
+                }
+                timeout = settleMs - quiet;
+            }
+            if (waitForChange(timeout))
+            {
+                lastChange = Clock::now();
+                if (!pending)
+                    firstChange = lastChange;
+                pending = true;
+            }
+        }
+    }
+
+#ifdef _WIN32
+    static uint64_t fileStamp(const std::string &path)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+            return 0;
+        uint64_t time = (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+        return time ^ ((uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow) * 0x9E3779B97F4A7C15ull;
+    }
+    bool openWatches()
+    {
+        for (size_t d = 0; d < dirs.size(); d++)
+        {
+            HANDLE handle = FindFirstChangeNotificationA(
+                dirs[d].c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+            if (handle != INVALID_HANDLE_VALUE)
+                handles.push_back(handle);
+        }
+        return !handles.empty();
+    }
+    void closeWatches()
+    {
+        for (size_t i = 0; i < handles.size(); i++)
+            FindCloseChangeNotification(handles[i]);
+        handles.clear();
+    }
+    // A directory change only says something in it changed; compare stamps
+    bool waitForChange(int timeoutMs)
+    {
+        DWORD result = WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, (DWORD)timeoutMs);
+        if (result - WAIT_OBJECT_0 >= handles.size()) // timeout or failure
+            return false;
+        FindNextChangeNotification(handles[result - WAIT_OBJECT_0]);
+        bool changed = false;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            uint64_t stamp = fileStamp(files[i].path);
+            changed = changed || stamp != files[i].stamp;
+            files[i].stamp = stamp;
+        }
+        return changed;
+    }
+#else
+    static uint64_t fileStamp(const std::string &) { return 0; }
+    bool openWatches()
+    {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+            return false;
+        bool any = false;
+        for (size_t d = 0; d < dirs.size(); d++)
+        {
+            // Written in place (close after write) or saved by rename
+            descriptors.push_back(inotify_add_watch(fd, dirs[d].c_str(), IN_CLOSE_WRITE | IN_MOVED_TO));
+            any = any || descriptors.back() >= 0;
+        }
+        return any;
+    }
+    void closeWatches()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        descriptors.clear();
+    }
+    bool waitForChange(int timeoutMs)
+    {
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, timeoutMs) <= 0)
+            return false;
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (ssize_t offset = 0; offset < length;)
+            {
+                const inotify_event *event = (const inotify_event *)(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+                for (size_t i = 0; i < files.size(); i++)
+                {
+                    bool sameDir = false;
+                    for (size_t d = 0; d < dirs.size() && !sameDir; d++)
+                        sameDir = descriptors[d] == event->wd && dirs[d] == files[i].dir;
+                    changed = changed || (sameDir && files[i].name == event->name);
+                }
+            }
+        }
+        return changed;
+    }
+#endif
+};
@@ -0,0 +1,503 @@
+// loadBench.cpp
+// Mesh ingestion benchmark; headless, never creates a GL context.
+//   loadBench [--faces N] [--runs N] [--lod N] [--case name] [--keep] [--verbose]
+// Generates synthetic OBJ files of about N face records (default 250000)
+// with different feature mixes, then constructs an ObjLoader on each (cooked
+// cache off, everything else as the options say) and measures the whole
+// load: parse, triangulate, normals, weld, optimise, LODs, edges.
+// Every case is loaded `runs` times with the file dropped from the page
+// cache first (cold) and `runs` times after a warm-up load (warm); the best
+// and mean times are reported along with MB/s, OBJ vertices/s, peak RSS and
+// the operator new calls and bytes of one load.
+// The results go to stdout as JSON; the loader's own log lines are kept off
+// stdout unless --verbose.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include "objLoader.h"
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation counting: every operator new in the process goes through here
+
+static atomic<size_t> allocationCount(0), allocationBytes(0);
+
+// malloc and free stay out of line so GCC cannot see them paired with the
+// operators below and report every inlined delete as a mismatch
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+static BENCH_NOINLINE void *countedAlloc(size_t size, size_t alignment)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    allocationBytes.fetch_add(size, memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    void *p;
+    if (alignment == 0)
+        p = malloc(size);
+#ifdef _WIN32
+    else
+        p = _aligned_malloc(size, alignment);
+#else
+    else if (posix_memalign(&p, alignment, size) != 0)
+        p = NULL;
+#endif
+    if (p == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+static BENCH_NOINLINE void countedFree(void *p, bool aligned)
+{
+#ifdef _WIN32
+    if (aligned)
+    {
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void)aligned;
+#endif
+    free(p);
+}
+
+void *operator new(size_t size)
+{
+    return countedAlloc(size, 0);
+}
+void *operator new[](size_t size)
+{
+    return countedAlloc(size, 0);
+}
+void operator delete(void *p) noexcept
+{
+    countedFree(p, false);
+}
+void operator delete[](void *p) noexcept
+{
+    countedFree(p, false);
+}
+void operator delete(void *p, size_t) noexcept
+{
+    countedFree(p, false);
+}
+void operator delete[](void *p, size_t) noexcept
+{
+    countedFree(p, false);
+}
+
+#ifdef __cpp_aligned_new
+// Over-aligned types (alignas above the default new alignment) come here
+void *operator new(size_t size, align_val_t alignment)
+{
+    return countedAlloc(size, (size_t)alignment);
+}
+void *operator new[](size_t size, align_val_t alignment)
+{
+    return countedAlloc(size, (size_t)alignment);
+}
+void operator delete(void *p, align_val_t) noexcept
+{
+    countedFree(p, true);
+}
+void operator delete[](void *p, align_val_t) noexcept
+{
+    countedFree(p, true);
+}
+void operator delete(void *p, size_t, align_val_t) noexcept
+{
+    countedFree(p, true);
+}
+void operator delete[](void *p, size_t, align_val_t) noexcept
+{
+    countedFree(p, true);
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Platform helpers
+
+// Peak resident set size in bytes since the last resetPeakRss()
+static size_t peakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == NULL)
+        return 0;
+    char line[256];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "VmHWM: %zu kB", &kb) == 1)
+            break;
+    fclose(file);
+    return kb * 1024;
+#endif
+}
+
+// Linux can restart the high-water mark; Windows only has the process peak,
+// so there the cases report a running maximum. Returns false if not reset.
+static bool resetPeakRss()
+{
+#ifdef _WIN32
+    return false;
+#else
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file == NULL)
+        return false;
+    bool ok = fputs("5", file) >= 0;
+    return fclose(file) == 0 && ok;
+#endif
+}
+
+// Evict a file from the OS page cache so the next read comes from disk.
+// Best effort: returns false where that isn't possible.
+static bool dropFromPageCache(const string &path)
+{
+#ifdef _WIN32
+    // Opening a file unbuffered makes the cache manager discard its pages
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                              FILE_FLAG_NO_BUFFERING, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    CloseHandle(file);
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    // Dirty pages can't be dropped, so write them back first
+    bool ok = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+// Sends stdout to the null device for its lifetime
+class QuietStdout
+{
+public:
+    explicit QuietStdout(bool quiet)
+    {
+        if (!quiet)
+            return;
+        fflush(stdout);
+#ifdef _WIN32
+        saved = _dup(_fileno(stdout));
+        int null = _open("NUL", _O_WRONLY);
+        if (null >= 0)
+        {
+            _dup2(null, _fileno(stdout));
+            _close(null);
+        }
+#else
+        saved = dup(fileno(stdout));
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+        {
+            dup2(null, fileno(stdout));
+            close(null);
+        }
+#endif
+    }
+    ~QuietStdout()
+    {
+        if (saved < 0)
+            return;
+        fflush(stdout);
+#ifdef _WIN32
+        _dup2(saved, _fileno(stdout));
+        _close(saved);
+#else
+        dup2(saved, fileno(stdout));
+        close(saved);
+#endif
+    }
+
+private:
+    int saved = -1;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Synthetic OBJ files
+
+struct SyntheticObj
+{
+    const char *name;
+    float quadFraction; // grid cells written as one quad instead of two triangles
+    bool normals;       // vn records and v/vt/vn corners, otherwise v/vt
+    bool relative;      // negative (relative) indices
+    int commentEvery;   // a comment line every this many faces, 0 for none
+};
+
+static const SyntheticObj syntheticCases[] = {
+    {"triangles", 0.0f, true, false, 0},
+    {"quads", 1.0f, true, false, 0},
+    {"no_normals", 0.0f, false, false, 0},
+    {"negative_indices", 0.0f, true, true, 0},
+    {"comments", 0.0f, true, false, 4},
+    {"mixed", 0.5f, false, true, 16},
+};
+
+struct GeneratedObj
+{
+    size_t bytes = 0;
+    size_t positions = 0;
+    size_t faces = 0;
+};
+
+static bool cellIsQuad(int i, int j, float quadFraction)
+{
+    uint32_t h = meshHashTriple(i, j, 0x51ED);
+    return (h & 0xFFFF) < quadFraction * 65536.0f;
+}
+
+// A wavy side x side grid. Row j + 1's records are written just before row
+// j's faces, as exporters that stream geometry do, so relative indices
+// count back from a different point on every row.
+static bool writeSyntheticObj(const string &path, const SyntheticObj &spec, size_t targetFaces, GeneratedObj &out)
+{
+    double facesPerCell = 2.0 - spec.quadFraction;
+    int side = max(1, (int)ceil(sqrt(targetFaces / facesPerCell)));
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    out = GeneratedObj();
+    fprintf(file, "# loadBench synthetic OBJ: %s, %d x %d grid\n", spec.name, side, side);
+    auto writeRow = [&](int j) {
+        if (spec.commentEvery > 0)
+            fprintf(file, "\n# vertices of row %d\n", j);
+        for (int i = 0; i <= side; i++)
+        {
+            float x = (float)i / side, z = (float)j / side;
+            float y = 0.05f * sinf(x * 31.0f) * cosf(z * 23.0f);
+            fprintf(file, "v %.6f %.6f %.6f\nvt %.5f %.5f\n", x, y, z, x, z);
+            if (spec.normals)
+            {
+                float dx = 0.05f * 31.0f * cosf(x * 31.0f) * cosf(z * 23.0f);
+                float dz = -0.05f * 23.0f * sinf(x * 31.0f) * sinf(z * 23.0f);
+                float length = sqrtf(dx * dx + 1.0f + dz * dz);
+                fprintf(file, "vn %.5f %.5f %.5f\n", -dx / length, 1.0f / length, -dz / length);
+            }
+            out.positions++;
+        }
+    };
+    auto writeCorner = [&](int index) {
+        int n = spec.relative ? index - (int)out.positions : index + 1;
+        if (spec.normals)
+            fprintf(file, " %d/%d/%d", n, n, n);
+        else
+            fprintf(file, " %d/%d", n, n);
+    };
+    auto endFace = [&]() {
+        fputc('\n', file);
+        out.faces++;
+        if (spec.commentEvery > 0 && out.faces % spec.commentEvery == 0)
+            fprintf(file, "# %zu faces so far\n", out.faces);
+    };
+    writeRow(0);
+    for (int j = 0; j < side; j++)
+    {
+        writeRow(j + 1);
+        for (int i = 0; i < side; i++)
+        {
+            int a = j * (side + 1) + i, b = a + 1, c = a + side + 2, d = a + side + 1;
+            fputc('f', file);
+            if (cellIsQuad(i, j, spec.quadFraction))
+            {
+                writeCorner(a), writeCorner(d), writeCorner(c), writeCorner(b);
+                endFace();
+                continue;
+            }
+            writeCorner(a), writeCorner(d), writeCorner(c);
+            endFace();
+            fputc('f', file);
+            writeCorner(a), writeCorner(c), writeCorner(b);
+            endFace();
+        }
+    }
+    long size = ftell(file);
+    out.bytes = size > 0 ? (size_t)size : 0;
+    return fclose(file) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Measurement
+
+struct LoadSample
+{
+    double seconds = 0.0;
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+    size_t peakRss = 0;
+    size_t residentBytes = 0; // ObjLoader::memoryFootprint() after the load
+    size_t vertices = 0;
+    size_t triangles = 0;
+};
+
+static LoadSample timeLoad(const string &path, const ObjLoadOptions &options, bool verbose)
+{
+    LoadSample sample;
+    resetPeakRss();
+    size_t count = allocationCount.load(), bytes = allocationBytes.load();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        QuietStdout quiet(!verbose);
+        ObjLoader loader(path, "", options);
+        sample.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        sample.allocations = allocationCount.load() - count;
+        sample.allocatedBytes = allocationBytes.load() - bytes;
+        sample.peakRss = peakRss();
+        sample.residentBytes = loader.memoryFootprint();
+        sample.vertices = loader.vertexCount();
+        sample.triangles = loader.triangleCount();
+    }
+    return sample;
+}
+
+// Best and mean of a series of loads, as a JSON object. cacheDropped: 1 or
+// 0 for cold series, -1 for warm ones.
+static void printSeries(const char *name, const vector<LoadSample> &samples, const GeneratedObj &file, int cacheDropped,
+                        bool last)
+{
+    LoadSample best = samples[0];
+    double total = 0.0;
+    size_t peak = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (samples[i].seconds < best.seconds)
+            best = samples[i];
+        total += samples[i].seconds;
+        peak = max(peak, samples[i].peakRss);
+    }
+    double megabytes = file.bytes / (1024.0 * 1024.0);
+    printf("      \"%s\": {\n", name);
+    if (cacheDropped >= 0)
+        printf("        \"page_cache_dropped\": %s,\n", cacheDropped ? "true" : "false");
+    printf("        \"runs\": %zu,\n", samples.size());
+    printf("        \"seconds_best\": %.6f,\n", best.seconds);
+    printf("        \"seconds_mean\": %.6f,\n", total / samples.size());
+    printf("        \"mb_per_second\": %.2f,\n", megabytes / best.seconds);
+    printf("        \"vertices_per_second\": %.0f,\n", file.positions / best.seconds);
+    printf("        \"faces_per_second\": %.0f,\n", file.faces / best.seconds);
+    printf("        \"peak_rss_bytes\": %zu,\n", peak);
+    printf("        \"allocations\": %zu,\n", best.allocations);
+    printf("        \"allocated_bytes\": %zu,\n", best.allocatedBytes);
+    printf("        \"resident_bytes\": %zu,\n", best.residentBytes);
+    printf("        \"welded_vertices\": %zu,\n", best.vertices);
+    printf("        \"triangles\": %zu\n", best.triangles);
+    printf("      }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+    size_t faces = 250000;
+    int runs = 3;
+    bool keep = false, verbose = false;
+    string only;
+    ObjLoadOptions options;
+    options.useMeshCache = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--faces" && hasValue)
+            faces = (size_t)atol(argv[++i]);
+        else if (arg == "--runs" && hasValue)
+            runs = max(1, atoi(argv[++i]));
+        else if (arg == "--lod" && hasValue)
+            options.lodLevels = max(1, atoi(argv[++i]));
+        else if (arg == "--case" && hasValue)
+            only = argv[++i];
+        else if (arg == "--keep")
+            keep = true;
+        else if (arg == "--verbose")
+            verbose = true;
+        else
+        {
+            fprintf(stderr, "usage: loadBench [--faces N] [--runs N] [--lod N] [--case name] [--keep] [--verbose]\n");
+            return 1;
+        }
+    }
+
+    bool rssResettable = resetPeakRss();
+    printf("{\n");
+    printf("  \"benchmark\": \"loadBench\",\n");
+    printf("  \"target_faces\": %zu,\n", faces);
+    printf("  \"options\": {\"optimize_vertex_cache\": %s, \"lod_levels\": %d, \"quantize_vertices\": %s, "
+           "\"build_meshlets\": %s, \"mesh_cache\": false},\n",
+           options.optimizeVertexCache ? "true" : "false", options.lodLevels, options.quantizeVertices ? "true" : "false",
+           options.buildMeshlets ? "true" : "false");
+    printf("  \"peak_rss_per_case\": %s,\n", rssResettable ? "true" : "false");
+    printf("  \"cases\": [\n");
+    size_t caseCount = sizeof(syntheticCases) / sizeof(syntheticCases[0]);
+    bool first = true;
+    for (size_t c = 0; c < caseCount; c++)
+    {
+        const SyntheticObj &spec = syntheticCases[c];
+        if (!only.empty() && only != spec.name)
+            continue;
+        string path = string("loadBench_") + spec.name + ".obj";
+        GeneratedObj file;
+        fprintf(stderr, "loadBench: %s: writing %s\n", spec.name, path.c_str());
+        if (!writeSyntheticObj(path, spec, faces, file))
+        {
+            fprintf(stderr, "loadBench: could not write %s\n", path.c_str());
+            return 1;
+        }
+
+        vector<LoadSample> cold, warm;
+        bool dropped = true;
+        for (int r = 0; r < runs; r++)
+        {
+            dropped = dropFromPageCache(path) && dropped;
+            cold.push_back(timeLoad(path, options, verbose));
+        }
+        timeLoad(path, options, verbose); // warm-up
+        for (int r = 0; r < runs; r++)
+            warm.push_back(timeLoad(path, options, verbose));
+        fprintf(stderr, "loadBench: %s: %.1f MB, cold %.1f ms, warm %.1f ms\n", spec.name, file.bytes / (1024.0 * 1024.0),
+                cold[0].seconds * 1000.0, warm[0].seconds * 1000.0);
+        if (!keep)
+            remove(path.c_str());
+
+        printf("%s    {\n", first ? "" : ",\n");
+        first = false;
+        printf("      \"name\": \"%s\",\n", spec.name);
+        printf("      \"features\": {\"quad_fraction\": %.2f, \"normals\": %s, \"negative_indices\": %s, "
+               "\"comment_every\": %d},\n",
+               spec.quadFraction, spec.normals ? "true" : "false", spec.relative ? "true" : "false", spec.commentEvery);
+        printf("      \"bytes\": %zu,\n", file.bytes);
+        printf("      \"vertices\": %zu,\n", file.positions);
+        printf("      \"faces\": %zu,\n", file.faces);
+        printSeries("cold", cold, file, dropped ? 1 : 0, false);
+        printSeries("warm", warm, file, -1, true);
+        printf("    }");
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
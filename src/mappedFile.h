@@ -0,0 +1,122 @@
+#pragma once
+// mappedFile.h
+// Read-only memory mapping of a whole file, for the OBJ parser and the
+// content hash.
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() {}
+    explicit MappedFile(const std::string &path) { open(path); }
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize))
+        {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+        opened = true;
+        if (length == 0) // Can't map an empty file, but it is still a valid (empty) input
+            return true;
+        hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping == NULL)
+        {
+            close();
+            return false;
+        }
+        ptr = (const char *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)st.st_size;
+        opened = true;
+        if (length == 0)
+        {
+            ::close(fd);
+            return true;
+        }
+        void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps its own reference
+        if (p == MAP_FAILED)
+            p = NULL;
+        else
+            madvise(p, length, MADV_SEQUENTIAL);
+        ptr = (const char *)p;
+#endif
+        if (ptr == NULL)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (ptr != NULL)
+            UnmapViewOfFile(ptr);
+        if (hMapping != NULL)
+            CloseHandle(hMapping);
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
+        hMapping = NULL;
+        hFile = INVALID_HANDLE_VALUE;
+#else
+        if (ptr != NULL)
+            munmap((void *)ptr, length);
+#endif
+        ptr = NULL;
+        length = 0;
+        opened = false;
+    }
+
+    const char *data() const { return ptr; }
+    size_t size() const { return length; }
+    bool isOpen() const { return opened; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    const char *ptr = NULL;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#endif
+};
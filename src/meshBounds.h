@@ -0,0 +1,248 @@
+#pragma once
+// meshBounds.h
+// Load-time bounding volumes: the exact axis-aligned box, computed with
+// SSE (or AVX when compiled for it), and a tight bounding sphere.
+#include <cmath>
+#include <cstddef>
+#include <cfloat>
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MESH_BOUNDS_AVX 1
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MESH_BOUNDS_SSE 1
+#endif
+
+struct MeshBounds
+{
+    float min[3];
+    float max[3];
+    float center[3]; // bounding sphere
+    float radius;
+
+    bool empty() const { return min[0] > max[0]; }
+};
+
+inline void meshBoundsClear(MeshBounds &b)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        b.min[k] = FLT_MAX;
+        b.max[k] = -FLT_MAX;
+        b.center[k] = 0.0f;
+    }
+    b.radius = 0.0f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Exact AABB of `count` points stored `stride` floats apart (3 for a packed
+// xyz array, 8 for MeshVertex)
+inline void meshComputeAabb(const float *points, size_t count, size_t stride, float outMin[3], float outMax[3])
+{
+    float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    size_t i = 0;
+    if (stride == 3)
+    {
+        // Packed xyz: a block of 4 (SSE) or 8 (AVX) points is 3 registers whose
+        // lanes cycle x, y, z, x, ... so min/max run on whole registers and the
+        // lanes are folded back onto components at the end.
+#if MESH_BOUNDS_AVX
+        __m256 mn[3], mx[3];
+        for (int r = 0; r < 3; r++)
+        {
+            mn[r] = _mm256_set1_ps(FLT_MAX);
+            mx[r] = _mm256_set1_ps(-FLT_MAX);
+        }
+        for (; i + 8 <= count; i += 8)
+        {
+            const float *p = points + i * 3;
+            for (int r = 0; r < 3; r++)
+            {
+                __m256 v = _mm256_loadu_ps(p + r * 8);
+                mn[r] = _mm256_min_ps(mn[r], v);
+                mx[r] = _mm256_max_ps(mx[r], v);
+            }
+        }
+        float laneMin[24], laneMax[24];
+        for (int r = 0; r < 3; r++)
+        {
+            _mm256_storeu_ps(laneMin + r * 8, mn[r]);
+            _mm256_storeu_ps(laneMax + r * 8, mx[r]);
+        }
+        for (int l = 0; l < 24; l++)
+        {
+            lo[l % 3] = laneMin[l] < lo[l % 3] ? laneMin[l] : lo[l % 3];
+            hi[l % 3] = laneMax[l] > hi[l % 3] ? laneMax[l] : hi[l % 3];
+        }
+#elif MESH_BOUNDS_SSE
+        __m128 mn[3], mx[3];
+        for (int r = 0; r < 3; r++)
+        {
+            mn[r] = _mm_set1_ps(FLT_MAX);
+            mx[r] = _mm_set1_ps(-FLT_MAX);
+        }
+        for (; i + 4 <= count; i += 4)
+        {
+            const float *p = points + i * 3;
+            for (int r = 0; r < 3; r++)
+            {
+                __m128 v = _mm_loadu_ps(p + r * 4);
+                mn[r] = _mm_min_ps(mn[r], v);
+                mx[r] = _mm_max_ps(mx[r], v);
+            }
+        }
+        float laneMin[12], laneMax[12];
+        for (int r = 0; r < 3; r++)
+        {
+            _mm_storeu_ps(laneMin + r * 4, mn[r]);
+            _mm_storeu_ps(laneMax + r * 4, mx[r]);
+        }
+        for (int l = 0; l < 12; l++)
+        {
+            lo[l % 3] = laneMin[l] < lo[l % 3] ? laneMin[l] : lo[l % 3];
+            hi[l % 3] = laneMax[l] > hi[l % 3] ? laneMax[l] : hi[l % 3];
+        }
+#endif
+    }
+#if MESH_BOUNDS_SSE
+    else if (stride >= 4)
+    {
+        // One point per register; the fourth lane (u for MeshVertex) is ignored
+        __m128 mn = _mm_set1_ps(FLT_MAX), mx = _mm_set1_ps(-FLT_MAX);
+        for (; i < count; i++)
+        {
+            __m128 v = _mm_loadu_ps(points + i * stride);
+            mn = _mm_min_ps(mn, v);
+            mx = _mm_max_ps(mx, v);
+        }
+        float laneMin[4], laneMax[4];
+        _mm_storeu_ps(laneMin, mn);
+        _mm_storeu_ps(laneMax, mx);
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = laneMin[k];
+            hi[k] = laneMax[k];
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        const float *p = points + i * stride;
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = p[k] < lo[k] ? p[k] : lo[k];
+            hi[k] = p[k] > hi[k] ? p[k] : hi[k];
+        }
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        outMin[k] = lo[k];
+        outMax[k] = hi[k];
+    }
+}
+
+inline float meshDistance2(const float *a, const float *b)
+{
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Largest squared distance from `center` to any point
+inline float meshMaxDistance2(const float *points, size_t count, size_t stride, const float center[3])
+{
+    float best = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        float d = meshDistance2(points + i * stride, center);
+        best = d > best ? d : best;
+    }
+    return best;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AABB plus bounding sphere. The sphere starts from the most distant pair of
+// extreme points along seven directions (axes and cube diagonals) and grows
+// Ritter-style to cover every point; the sphere around the box centre is
+// tried too and the smaller of the two kept. Typically within a few percent
+// of the minimal sphere, and never smaller than the points.
+inline MeshBounds meshComputeBounds(const float *points, size_t count, size_t stride = 3)
+{
+    MeshBounds b;
+    meshBoundsClear(b);
+    if (count == 0)
+        return b;
+    meshComputeAabb(points, count, stride, b.min, b.max);
+
+    static const float directions[7][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 1}, {1, 1, -1}, {1, -1, 1}, {1, -1, -1}};
+    size_t lowIndex[7] = {0}, highIndex[7] = {0};
+    float low[7], high[7];
+    for (int d = 0; d < 7; d++)
+        low[d] = high[d] = directions[d][0] * points[0] + directions[d][1] * points[1] + directions[d][2] * points[2];
+    for (size_t i = 1; i < count; i++)
+    {
+        const float *p = points + i * stride;
+        for (int d = 0; d < 7; d++)
+        {
+            float t = directions[d][0] * p[0] + directions[d][1] * p[1] + directions[d][2] * p[2];
+            if (t < low[d])
+            {
+                low[d] = t;
+                lowIndex[d] = i;
+            }
+            if (t > high[d])
+            {
+                high[d] = t;
+                highIndex[d] = i;
+            }
+        }
+    }
+    int widest = 0;
+    float widestDistance = -1.0f;
+    for (int d = 0; d < 7; d++)
+    {
+        float distance = meshDistance2(points + lowIndex[d] * stride, points + highIndex[d] * stride);
+        if (distance > widestDistance)
+        {
+            widestDistance = distance;
+            widest = d;
+        }
+    }
+    const float *a = points + lowIndex[widest] * stride;
+    const float *c = points + highIndex[widest] * stride;
+    float center[3] = {(a[0] + c[0]) * 0.5f, (a[1] + c[1]) * 0.5f, (a[2] + c[2]) * 0.5f};
+    float radius = sqrtf(widestDistance) * 0.5f;
+
+    // Grow to take in every outlier: the new sphere just touches the far side
+    // of the old one and the point
+    for (size_t i = 0; i < count; i++)
+    {
+        const float *p = points + i * stride;
+        float distance2 = meshDistance2(p, center);
+        if (distance2 > radius * radius)
+        {
+            float distance = sqrtf(distance2);
+            float grown = (radius + distance) * 0.5f;
+            float shift = (grown - radius) / distance;
+            for (int k = 0; k < 3; k++)
+                center[k] += (p[k] - center[k]) * shift;
+            radius = grown;
+        }
+    }
+    // Float rounding in the shifts can leave a point a hair outside
+    radius = sqrtf(meshMaxDistance2(points, count, stride, center));
+
+    float boxCenter[3] = {(b.min[0] + b.max[0]) * 0.5f, (b.min[1] + b.max[1]) * 0.5f, (b.min[2] + b.max[2]) * 0.5f};
+    float boxRadius = sqrtf(meshMaxDistance2(points, count, stride, boxCenter));
+    if (boxRadius < radius)
+    {
+        radius = boxRadius;
+        for (int k = 0; k < 3; k++)
+            center[k] = boxCenter[k];
+    }
+    for (int k = 0; k < 3; k++)
+        b.center[k] = center[k];
+    b.radius = radius;
+    return b;
+}
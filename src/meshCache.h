@@ -0,0 +1,310 @@
+#pragma once
+// meshCache.h
+// Versioned binary "cooked" mesh files. A cooked file holds the welded
+// vertex and index buffers ready for upload (vertices as MeshVertex or, when
+// quantized, as QuantizedVertex), the LOD table, the material subsets and
+// names, the bounding box and sphere, and the size, timestamp and content
+// hash of the source OBJ. Loading one is a memory map and a few copies, with
+// no text parsing.
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "objParser.h"
+#include "contentHash.h"
+#include "meshWeld.h"
+#include "meshBounds.h"
+#include "meshQuantize.h"
+
+const uint32_t COOKED_MESH_VERSION = 6;
+const char COOKED_MESH_MAGIC[8] = {'O', 'B', 'J', 'C', 'O', 'O', 'K', '\0'};
+
+// Flags describing how the buffers were produced; a cooked file is only
+// reused when they match what the loader asks for.
+const uint32_t COOKED_MESH_OPTIMIZED = 1u << 0;
+const uint32_t COOKED_MESH_QUANTIZED = 1u << 1; // vertex section is QuantizedVertex
+const int COOKED_MESH_LOD_SHIFT = 8; // bits 8..15: requested LOD level count
+
+inline uint32_t meshCookFlags(bool optimized, int lodLevels, bool quantized = false)
+{
+    return (optimized ? COOKED_MESH_OPTIMIZED : 0) | (quantized ? COOKED_MESH_QUANTIZED : 0) |
+           ((uint32_t)(lodLevels & 0xFF) << COOKED_MESH_LOD_SHIFT);
+}
+
+inline uint32_t meshCookedVertexStride(uint32_t flags)
+{
+    return (flags & COOKED_MESH_QUANTIZED) ? (uint32_t)sizeof(QuantizedVertex) : (uint32_t)sizeof(MeshVertex);
+}
+
+struct CookedMeshHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexStride; // sizeof(MeshVertex) or sizeof(QuantizedVertex)
+    uint64_t sourceSize;
+    int64_t sourceTime;    // modification time of the OBJ when cooked, see meshFileInfo()
+    uint64_t sourceHash;   // contentHashBytes() of the whole OBJ
+    uint32_t vertexCount;
+    uint32_t indexCount;   // all levels, as uploaded
+    uint32_t flags;
+    uint32_t lodCount;     // MeshLod entries; 0 when only the full mesh is stored
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphereCenter[3];
+    float sphereRadius;
+    QuantizationParams quantization;   // zero unless COOKED_MESH_QUANTIZED
+    QuantizationError quantizationError;
+    uint32_t subsetCount;  // MeshSubset entries, all levels
+    uint64_t vertexOffset; // from the start of the file, 16-byte aligned
+    uint64_t indexOffset;
+    uint64_t lodOffset;
+    uint64_t subsetOffset;
+    uint64_t stringOffset; // NUL-terminated names: material libraries, then materials
+    uint64_t stringSize;
+    uint32_t materialLibraryCount;
+    uint32_t materialCount;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+// Size and modification time. The time is in the finest unit the platform
+// keeps (100 ns FILETIME ticks on Windows, nanoseconds elsewhere), so edits
+// within the same second still change it.
+inline bool meshFileInfo(const std::string &path, uint64_t &size, int64_t &time)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+        return false;
+    size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+    time = (int64_t)((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    time = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    time = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+inline FILE *meshOpenFile(const std::string &path, const char *mode)
+{
+#ifdef _WIN32
+    FILE *file = NULL;
+    if (fopen_s(&file, path.c_str(), mode) != 0)
+        return NULL;
+    return file;
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+// Record a new source time in a cooked file whose source was found unchanged
+// by its hash, so later loads can trust the time again instead of rehashing
+inline bool meshRestampCooked(const std::string &cachePath, int64_t sourceTime)
+{
+    FILE *file = meshOpenFile(cachePath, "r+b");
+    if (file == NULL)
+        return false;
+    bool ok = fseek(file, (long)offsetof(CookedMeshHeader, sourceTime), SEEK_SET) == 0 &&
+              fwrite(&sourceTime, sizeof(sourceTime), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+inline uint64_t meshAlign16(uint64_t offset) { return (offset + 15) & ~(uint64_t)15; }
+
+///////////////////////////////////////////////////////////////////////////////
+// Write `mesh` as the cooked form of `sourcePath`. The file is written under
+// a temporary name and renamed, so a crash never leaves a torn cache behind.
+// With COOKED_MESH_QUANTIZED in `flags` the vertices are taken from
+// `quantized` instead of mesh.vertices.
+inline bool meshSaveCooked(const std::string &cachePath, const std::string &sourcePath, const IndexedMesh &mesh,
+                           uint32_t flags, const MeshBounds &bounds, const QuantizedMesh *quantized = NULL)
+{
+    bool quantize = (flags & COOKED_MESH_QUANTIZED) != 0;
+    if (quantize && (quantized == NULL || quantized->vertices.size() != mesh.vertices.size()))
+        return false;
+    CookedMeshHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COOKED_MESH_MAGIC, sizeof(header.magic));
+    header.version = COOKED_MESH_VERSION;
+    header.vertexStride = meshCookedVertexStride(flags);
+    if (!meshFileInfo(sourcePath, header.sourceSize, header.sourceTime) || !contentHashFile(sourcePath, header.sourceHash))
+        return false;
+    header.vertexCount = (uint32_t)mesh.vertices.size();
+    header.indexCount = (uint32_t)mesh.drawIndexCount();
+    header.flags = flags;
+    header.lodCount = (uint32_t)mesh.lods.size();
+    memcpy(header.boundsMin, bounds.min, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, bounds.max, sizeof(header.boundsMax));
+    memcpy(header.sphereCenter, bounds.center, sizeof(header.sphereCenter));
+    header.sphereRadius = bounds.radius;
+    if (quantize)
+    {
+        header.quantization = quantized->params;
+        header.quantizationError = quantized->error;
+    }
+    header.subsetCount = (uint32_t)mesh.subsets.size();
+    header.materialLibraryCount = (uint32_t)mesh.materialLibraries.size();
+    header.materialCount = (uint32_t)mesh.materials.size();
+    std::string strings;
+    for (size_t i = 0; i < mesh.materialLibraries.size(); i++)
+        strings.append(mesh.materialLibraries[i].c_str(), mesh.materialLibraries[i].size() + 1);
+    for (size_t i = 0; i < mesh.materials.size(); i++)
+        strings.append(mesh.materials[i].c_str(), mesh.materials[i].size() + 1);
+    header.stringSize = strings.size();
+    header.vertexOffset = meshAlign16(sizeof(header));
+    header.indexOffset = meshAlign16(header.vertexOffset + (uint64_t)header.vertexCount * header.vertexStride);
+    header.lodOffset = meshAlign16(header.indexOffset + header.indexCount * sizeof(uint32_t));
+    header.subsetOffset = header.lodOffset + header.lodCount * sizeof(MeshLod);
+    header.stringOffset = header.subsetOffset + header.subsetCount * sizeof(MeshSubset);
+
+    std::string tempPath = cachePath + ".tmp";
+    FILE *file = meshOpenFile(tempPath, "wb");
+    if (file == NULL)
+        return false;
+    static const char padding[16] = {0};
+    uint64_t vertexEnd = header.vertexOffset + (uint64_t)header.vertexCount * header.vertexStride;
+    const void *vertexData = quantize ? (const void *)quantized->vertices.data() : (const void *)mesh.vertices.data();
+    uint64_t indexEnd = header.indexOffset + header.indexCount * sizeof(uint32_t);
+    size_t headerPad = (size_t)(header.vertexOffset - sizeof(header));
+    size_t vertexPad = (size_t)(header.indexOffset - vertexEnd);
+    size_t indexPad = (size_t)(header.lodOffset - indexEnd);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && headerPad != 0)
+        ok = fwrite(padding, headerPad, 1, file) == 1;
+    if (ok && header.vertexCount != 0)
+        ok = fwrite(vertexData, header.vertexStride, header.vertexCount, file) == header.vertexCount;
+    if (ok && vertexPad != 0)
+        ok = fwrite(padding, vertexPad, 1, file) == 1;
+    if (ok && !mesh.indices.empty())
+        ok = fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size();
+    if (ok && !mesh.lodIndices.empty())
+        ok = fwrite(mesh.lodIndices.data(), sizeof(uint32_t), mesh.lodIndices.size(), file) == mesh.lodIndices.size();
+    if (ok && indexPad != 0)
+        ok = fwrite(padding, indexPad, 1, file) == 1;
+    if (ok && header.lodCount != 0)
+        ok = fwrite(mesh.lods.data(), sizeof(MeshLod), header.lodCount, file) == header.lodCount;
+    if (ok && header.subsetCount != 0)
+        ok = fwrite(mesh.subsets.data(), sizeof(MeshSubset), header.subsetCount, file) == header.subsetCount;
+    if (ok && !strings.empty())
+        ok = fwrite(strings.data(), strings.size(), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+    remove(cachePath.c_str()); // rename() won't replace an existing file on Windows
+    return rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+// Load the cooked form of `sourcePath` if it exists and is still valid: same
+// format version and flags, and the OBJ has the same size and either the same
+// timestamp or, failing that, the same content hash. The timestamp alone is
+// only trusted when the OBJ was last written before the cache was, since an
+// edit in the same clock tick as the cook would keep it. After a hash match
+// the new timestamp is written back. A quantized file fills `quantized`
+// (required then) and decodes it into mesh.vertices.
+inline bool meshLoadCooked(const std::string &cachePath, const std::string &sourcePath, uint32_t flags,
+                           IndexedMesh &mesh, MeshBounds &bounds, QuantizedMesh *quantized = NULL)
+{
+    bool quantize = (flags & COOKED_MESH_QUANTIZED) != 0;
+    if (quantize && quantized == NULL)
+        return false;
+    MappedFile file(cachePath);
+    if (!file.isOpen() || file.size() < sizeof(CookedMeshHeader))
+        return false;
+    CookedMeshHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, COOKED_MESH_MAGIC, sizeof(header.magic)) != 0 || header.version != COOKED_MESH_VERSION ||
+        header.vertexStride != meshCookedVertexStride(flags) || header.flags != flags)
+        return false;
+    if (header.vertexOffset + (uint64_t)header.vertexCount * header.vertexStride > file.size() ||
+        header.indexOffset + (uint64_t)header.indexCount * sizeof(uint32_t) > file.size() ||
+        header.lodOffset + (uint64_t)header.lodCount * sizeof(MeshLod) > file.size() ||
+        header.subsetOffset + (uint64_t)header.subsetCount * sizeof(MeshSubset) > file.size() ||
+        header.stringOffset + header.stringSize > file.size())
+        return false;
+
+    uint64_t sourceSize, cacheSize;
+    int64_t sourceTime, cacheTime;
+    if (!meshFileInfo(sourcePath, sourceSize, sourceTime) || sourceSize != header.sourceSize)
+        return false;
+    bool restamp = false;
+    if (sourceTime != header.sourceTime || !meshFileInfo(cachePath, cacheSize, cacheTime) || sourceTime >= cacheTime)
+    {
+        uint64_t hash;
+        if (!contentHashFile(sourcePath, hash) || hash != header.sourceHash)
+            return false;
+        restamp = true;
+    }
+
+    const uint32_t *indices = (const uint32_t *)(file.data() + header.indexOffset);
+    const MeshLod *lods = (const MeshLod *)(file.data() + header.lodOffset);
+    for (uint32_t i = 0; i < header.indexCount; i++)
+        if (indices[i] >= header.vertexCount)
+            return false;
+    uint32_t fullCount = header.lodCount != 0 ? lods[0].indexCount : header.indexCount;
+    for (uint32_t l = 0; l < header.lodCount; l++)
+        if ((uint64_t)lods[l].indexOffset + lods[l].indexCount > header.indexCount)
+            return false;
+    if (fullCount > header.indexCount || (header.lodCount != 0 && lods[0].indexOffset != 0))
+        return false;
+    const MeshSubset *subsets = (const MeshSubset *)(file.data() + header.subsetOffset);
+    if (header.subsetCount % (header.lodCount != 0 ? header.lodCount : 1) != 0)
+        return false;
+    for (uint32_t i = 0; i < header.subsetCount; i++)
+        if ((uint64_t)subsets[i].indexOffset + subsets[i].indexCount > header.indexCount ||
+            subsets[i].material < -1 || subsets[i].material >= (int32_t)header.materialCount)
+            return false;
+    std::vector<std::string> strings;
+    const char *text = file.data() + header.stringOffset, *textEnd = text + header.stringSize;
+    while (text < textEnd)
+    {
+        const char *nul = (const char *)memchr(text, '\0', textEnd - text);
+        if (nul == NULL)
+            return false;
+        strings.push_back(std::string(text, nul));
+        text = nul + 1;
+    }
+    if (strings.size() != (size_t)header.materialLibraryCount + header.materialCount)
+        return false;
+    if (quantize)
+    {
+        const QuantizedVertex *vertices = (const QuantizedVertex *)(file.data() + header.vertexOffset);
+        quantized->vertices.assign(vertices, vertices + header.vertexCount);
+        quantized->params = header.quantization;
+        quantized->error = header.quantizationError;
+        meshDequantize(*quantized, mesh.vertices);
+    }
+    else
+    {
+        const MeshVertex *vertices = (const MeshVertex *)(file.data() + header.vertexOffset);
+        mesh.vertices.assign(vertices, vertices + header.vertexCount);
+    }
+    mesh.indices.assign(indices, indices + fullCount);
+    mesh.lodIndices.assign(indices + fullCount, indices + header.indexCount);
+    mesh.lods.assign(lods, lods + header.lodCount);
+    mesh.subsets.assign(subsets, subsets + header.subsetCount);
+    mesh.materialLibraries.assign(strings.begin(), strings.begin() + header.materialLibraryCount);
+    mesh.materials.assign(strings.begin() + header.materialLibraryCount, strings.end());
+    memcpy(bounds.min, header.boundsMin, sizeof(header.boundsMin));
+    memcpy(bounds.max, header.boundsMax, sizeof(header.boundsMax));
+    memcpy(bounds.center, header.sphereCenter, sizeof(header.sphereCenter));
+    bounds.radius = header.sphereRadius;
+    file.close(); // Windows maps without write sharing
+    if (restamp)
+        meshRestampCooked(cachePath, sourceTime);
+    return true;
+}
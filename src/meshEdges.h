@@ -0,0 +1,160 @@
+#pragma once
+// meshEdges.h
+// Unique edge extraction for wireframe drawing. Each edge shared by two
+// triangles becomes one GL_LINES segment instead of being drawn once per
+// triangle, which halves the lines of a closed mesh.
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "meshWeld.h"
+#include "parallelFor.h"
+
+// Line lists of every level of an IndexedMesh
+struct MeshEdges
+{
+    std::vector<uint32_t> indices; // index pairs, level after level
+    std::vector<MeshLod> levels;   // one per mesh level: its range of `indices`
+
+    size_t lineCount(size_t level) const { return levels.empty() ? 0 : levels[level].indexCount / 2; }
+    size_t memoryFootprint() const
+    {
+        return indices.capacity() * sizeof(uint32_t) + levels.capacity() * sizeof(MeshLod);
+    }
+    void clear()
+    {
+        indices.clear();
+        levels.clear();
+    }
+};
+
+inline uint32_t meshHashEdge(uint32_t a, uint32_t b)
+{
+    uint64_t h = ((uint64_t)a << 32 | b) * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(h >> 32) ^ (uint32_t)h;
+}
+
+// For each vertex, the first vertex with the same position. Welding splits
+// positions along UV seams and hard normals; without this those edges would
+// still be drawn once per side (every edge of a faceted mesh).
+inline void meshCanonicalPositions(const IndexedMesh &mesh, std::vector<uint32_t> &canonical)
+{
+    size_t vertexCount = mesh.vertexCount();
+    canonical.resize(vertexCount);
+    size_t capacity = 16;
+    while (capacity < vertexCount * 2)
+        capacity <<= 1;
+    const uint32_t empty = 0xFFFFFFFFu;
+    std::vector<uint32_t> slots(capacity, empty);
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        // + 0.0f turns -0 into +0, which compares equal but differs in bits
+        float position[3] = {mesh.vertices[i].px + 0.0f, mesh.vertices[i].py + 0.0f, mesh.vertices[i].pz + 0.0f};
+        uint32_t bits[3];
+        memcpy(bits, position, sizeof(bits));
+        size_t slot = meshHashTriple((int)bits[0], (int)bits[1], (int)bits[2]) & mask;
+        for (;;)
+        {
+            uint32_t index = slots[slot];
+            if (index == empty)
+            {
+                slots[slot] = (uint32_t)i;
+                canonical[i] = (uint32_t)i;
+                break;
+            }
+            const MeshVertex &other = mesh.vertices[index];
+            if (other.px + 0.0f == position[0] && other.py + 0.0f == position[1] && other.pz + 0.0f == position[2])
+            {
+                canonical[i] = index;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Append the unique edges of a triangle list to `edges` as index pairs, in
+// order of first use so they keep the triangles' vertex locality. Vertex
+// indices go through `canonical` first; an edge is keyed by its sorted pair.
+// Degenerate edges are dropped. Returns the number of edges appended.
+inline size_t meshAppendUniqueEdges(const uint32_t *indices, size_t indexCount, const std::vector<uint32_t> &canonical,
+                                    std::vector<uint32_t> &edges)
+{
+    // A closed mesh has half as many edges as corners, a triangle soup as
+    // many; size the table for the soup so probes stay short either way
+    size_t capacity = 16;
+    while (capacity < indexCount + indexCount / 2)
+        capacity <<= 1;
+    const uint64_t empty = ~0ull;
+    std::vector<uint64_t> slots(capacity, empty);
+    size_t mask = capacity - 1;
+    size_t first = edges.size();
+    edges.reserve(first + indexCount);
+    for (size_t t = 0; t + 2 < indexCount; t += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = canonical[indices[t + k]];
+            uint32_t b = canonical[indices[t + (k + 1) % 3]];
+            if (a == b)
+                continue;
+            if (a > b)
+            {
+                uint32_t swap = a;
+                a = b;
+                b = swap;
+            }
+            uint64_t key = (uint64_t)a << 32 | b;
+            size_t slot = meshHashEdge(a, b) & mask;
+            while (slots[slot] != empty && slots[slot] != key)
+                slot = (slot + 1) & mask;
+            if (slots[slot] == empty)
+            {
+                slots[slot] = key;
+                edges.push_back(a);
+                edges.push_back(b);
+            }
+        }
+    }
+    return (edges.size() - first) / 2;
+}
+
+// The unique edges of every level of `mesh` (the full mesh and its LOD
+// chain), levels extracted in parallel
+inline void meshBuildEdges(const IndexedMesh &mesh, MeshEdges &out, int threadCount = 0)
+{
+    out.clear();
+    if (mesh.vertexCount() == 0)
+        return;
+    std::vector<uint32_t> canonical;
+    meshCanonicalPositions(mesh, canonical);
+
+    size_t levelCount = mesh.levelCount();
+    std::vector<std::vector<uint32_t>> levelEdges(levelCount);
+    parallelFor(levelCount, threadCount, 1, [&](size_t begin, size_t end) {
+        for (size_t l = begin; l < end; l++)
+        {
+            const uint32_t *indices = mesh.indices.data();
+            size_t count = mesh.indices.size();
+            if (l > 0)
+            {
+                indices = mesh.lodIndices.data() + (mesh.lods[l].indexOffset - mesh.indices.size());
+                count = mesh.lods[l].indexCount;
+            }
+            meshAppendUniqueEdges(indices, count, canonical, levelEdges[l]);
+        }
+    });
+
+    size_t total = 0;
+    for (size_t l = 0; l < levelCount; l++)
+        total += levelEdges[l].size();
+    out.indices.reserve(total);
+    for (size_t l = 0; l < levelCount; l++)
+    {
+        MeshLod level = {(uint32_t)out.indices.size(), (uint32_t)levelEdges[l].size(),
+                         mesh.lods.empty() ? 0.0f : mesh.lods[l].error};
+        out.levels.push_back(level);
+        out.indices.insert(out.indices.end(), levelEdges[l].begin(), levelEdges[l].end());
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+// meshNormals.h
+// Load-time normal passes: smooth normals for OBJ files without vn records,
+// per-face normals, and the unshared vertex stream used for flat shading.
+// Everything is computed once so the draw loop does no arithmetic.
+#include <cmath>
+#include <vector>
+#include "objParser.h"
+#include "meshWeld.h"
+#include "parallelFor.h"
+
+inline void meshNormalize3(float *n)
+{
+    float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length > 0.0f)
+    {
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Give every corner without a vn index a smooth normal. One normal per
+// position is generated as the area-weighted sum of the adjacent face
+// normals and appended to mesh.normals. Returns false if nothing was missing.
+inline bool meshGenerateNormals(ObjMeshData &mesh, int threadCount = 0)
+{
+    size_t positionCount = mesh.positionCount();
+    size_t faceCount = mesh.faceCount();
+    size_t missing = 0;
+    for (size_t c = 0; c < mesh.cornerCount(); c++)
+        if (mesh.cornerVN[c] < 0 || mesh.cornerVN[c] >= (int)mesh.normalCount())
+            missing++;
+    if (missing == 0 || positionCount == 0)
+        return false;
+
+    const float *positions = mesh.positions.data();
+    const int *faceOffsets = mesh.faceOffsets.data();
+    const int *cornerV = mesh.cornerV.data();
+
+    // Unnormalised face normals (fan cross products, so length ~ area)
+    std::vector<float> faceNormals(faceCount * 3, 0.0f);
+    parallelFor(faceCount, threadCount, 4096, [&](size_t begin, size_t end) {
+        for (size_t f = begin; f < end; f++)
+        {
+            float *n = &faceNormals[f * 3];
+            int first = faceOffsets[f];
+            int last = faceOffsets[f + 1];
+            for (int c = first + 1; c + 1 < last; c++)
+            {
+                int i0 = cornerV[first], i1 = cornerV[c], i2 = cornerV[c + 1];
+                if (i0 < 0 || i1 < 0 || i2 < 0 || i0 >= (int)positionCount || i1 >= (int)positionCount || i2 >= (int)positionCount)
+                    continue;
+                const float *a = &positions[i0 * 3];
+                const float *b = &positions[i1 * 3];
+                const float *d = &positions[i2 * 3];
+                float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+                float e2[3] = {d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+                n[0] += e1[1] * e2[2] - e1[2] * e2[1];
+                n[1] += e1[2] * e2[0] - e1[0] * e2[2];
+                n[2] += e1[0] * e2[1] - e1[1] * e2[0];
+            }
+        }
+    });
+
+    // Position -> faces adjacency (CSR), so each normal is a private gather
+    std::vector<int> adjacencyOffsets(positionCount + 1, 0);
+    for (size_t c = 0; c < mesh.cornerCount(); c++)
+        if (cornerV[c] >= 0 && cornerV[c] < (int)positionCount)
+            adjacencyOffsets[cornerV[c] + 1]++;
+    for (size_t i = 0; i < positionCount; i++)
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    std::vector<int> adjacency(adjacencyOffsets[positionCount]);
+    std::vector<int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t f = 0; f < faceCount; f++)
+        for (int c = faceOffsets[f]; c < faceOffsets[f + 1]; c++)
+            if (cornerV[c] >= 0 && cornerV[c] < (int)positionCount)
+                adjacency[fill[cornerV[c]]++] = (int)f;
+
+    size_t base = mesh.normals.size();
+    mesh.normals.resize(base + positionCount * 3);
+    float *generated = &mesh.normals[base];
+    parallelFor(positionCount, threadCount, 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            float n[3] = {0.0f, 0.0f, 0.0f};
+            for (int a = adjacencyOffsets[i]; a < adjacencyOffsets[i + 1]; a++)
+            {
+                const float *fn = &faceNormals[adjacency[a] * 3];
+                n[0] += fn[0];
+                n[1] += fn[1];
+                n[2] += fn[2];
+            }
+            meshNormalize3(n);
+            generated[i * 3 + 0] = n[0];
+            generated[i * 3 + 1] = n[1];
+            generated[i * 3 + 2] = n[2];
+        }
+    });
+
+    int normalBase = (int)(base / 3);
+    int normalCount = (int)mesh.normalCount();
+    for (size_t c = 0; c < mesh.cornerCount(); c++)
+        if (mesh.cornerVN[c] < 0 || mesh.cornerVN[c] >= normalCount)
+            mesh.cornerVN[c] = cornerV[c] >= 0 ? normalBase + cornerV[c] : -1;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Unit normal of one triangle: the average of its corner normals, as the old
+// immediate-mode path used, or the geometric normal if those cancel out.
+inline void meshTriangleNormal(const MeshVertex &a, const MeshVertex &b, const MeshVertex &c, float *n)
+{
+    n[0] = a.nx + b.nx + c.nx;
+    n[1] = a.ny + b.ny + c.ny;
+    n[2] = a.nz + b.nz + c.nz;
+    if (n[0] * n[0] + n[1] * n[1] + n[2] * n[2] < 1e-12f)
+    {
+        float e1[3] = {b.px - a.px, b.py - a.py, b.pz - a.pz};
+        float e2[3] = {c.px - a.px, c.py - a.py, c.pz - a.pz};
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+    meshNormalize3(n);
+}
+
+// One unit normal per full-detail triangle
+inline void meshComputeFaceNormals(const IndexedMesh &mesh, std::vector<float> &faceNormals, int threadCount = 0)
+{
+    size_t triangleCount = mesh.triangleCount();
+    faceNormals.resize(triangleCount * 3);
+    const MeshVertex *vertices = mesh.vertices.data();
+    const uint32_t *indices = mesh.indices.data();
+    parallelFor(triangleCount, threadCount, 4096, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+            meshTriangleNormal(vertices[indices[t * 3 + 0]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]],
+                               &faceNormals[t * 3]);
+    });
+}
+
+// Unshared triangle-list stream (3 vertices per triangle) carrying the face
+// normal on every corner, drawn with glDrawArrays for flat shading. It
+// follows the uploaded index buffer, full detail and then every coarser
+// level, so a level's index range is also its range of flat vertices.
+inline void meshBuildFlatVertices(const IndexedMesh &mesh, const std::vector<float> &faceNormals, std::vector<MeshVertex> &out)
+{
+    size_t triangleCount = mesh.triangleCount();
+    out.resize(mesh.drawIndexCount());
+    for (size_t t = 0; t < out.size() / 3; t++)
+    {
+        const uint32_t *corners = t < triangleCount ? &mesh.indices[t * 3] : &mesh.lodIndices[(t - triangleCount) * 3];
+        float normal[3];
+        const float *n = &faceNormals[t * 3];
+        if (t >= triangleCount)
+        {
+            meshTriangleNormal(mesh.vertices[corners[0]], mesh.vertices[corners[1]], mesh.vertices[corners[2]], normal);
+            n = normal;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            MeshVertex v = mesh.vertices[corners[k]];
+            v.nx = n[0];
+            v.ny = n[1];
+            v.nz = n[2];
+            out[t * 3 + k] = v;
+        }
+    }
+}
@@ -0,0 +1,243 @@
+#pragma once
+// meshOptimize.h
+// Load-time reordering of indexed meshes for the GPU:
+//  - triangle order for post-transform vertex cache reuse (Tom Forsyth's
+//    "Linear-Speed Vertex Cache Optimisation")
+//  - vertex order by first use, for vertex fetch locality
+// plus a FIFO cache simulation that reports ACMR / ATVR.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "meshWeld.h"
+
+struct VertexCacheStats
+{
+    size_t triangles = 0;
+    size_t vertices = 0;
+    size_t misses = 0;
+    double acmr = 0.0; // average cache miss ratio: transformed vertices per triangle (0.5 .. 3)
+    double atvr = 0.0; // average transformed vertex ratio: transforms per vertex (1 is ideal)
+};
+
+// Simulate a FIFO post-transform cache of `cacheSize` entries
+inline VertexCacheStats meshAnalyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned cacheSize = 16)
+{
+    VertexCacheStats stats;
+    std::vector<unsigned> timestamps(vertexCount, 0);
+    unsigned time = cacheSize + 1;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        uint32_t v = indices[i];
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            stats.misses++;
+        }
+    }
+    stats.triangles = indices.size() / 3;
+    stats.vertices = vertexCount;
+    stats.acmr = stats.triangles ? (double)stats.misses / stats.triangles : 0.0;
+    stats.atvr = vertexCount ? (double)stats.misses / vertexCount : 0.0;
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Forsyth vertex cache optimisation
+
+const int MESH_FORSYTH_CACHE_SIZE = 32;
+
+inline float meshForsythVertexScore(int cachePosition, int liveTriangles)
+{
+    if (liveTriangles == 0)
+        return -1.0f; // no triangles left, never pick it
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+            score = 0.75f; // just used by the last triangle; fixed so strips aren't favoured
+        else
+        {
+            float scaler = 1.0f / (MESH_FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, 1.5f);
+        }
+    }
+    // Boost vertices with few triangles left so stragglers get finished
+    score += 2.0f * powf((float)liveTriangles, -0.5f);
+    return score;
+}
+
+// Reorder the triangles of `indices` in place
+inline void meshOptimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Vertex -> triangles adjacency; liveTriangles[v] shrinks as triangles are emitted
+    std::vector<int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++)
+        liveTriangles[indices[i]]++;
+    std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = meshForsythVertexScore(-1, liveTriangles[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    int bestTriangle = -1;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        if (triangleScore[t] > bestScore)
+        {
+            bestScore = triangleScore[t];
+            bestTriangle = (int)t;
+        }
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t cache[MESH_FORSYTH_CACHE_SIZE + 3];
+    uint32_t newCache[MESH_FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    size_t nextUnemitted = 0;
+
+    while (output.size() < indices.size())
+    {
+        if (bestTriangle < 0)
+        {
+            // Nothing in the cache touches a live triangle: take the next in input order
+            while (emitted[nextUnemitted])
+                nextUnemitted++;
+            bestTriangle = (int)nextUnemitted;
+        }
+
+        const uint32_t *tri = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = 1;
+        output.push_back(tri[0]);
+        output.push_back(tri[1]);
+        output.push_back(tri[2]);
+
+        // Drop the triangle from its vertices' live lists
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = tri[k];
+            int *list = &adjacency[adjacencyOffsets[v]];
+            int count = liveTriangles[v];
+            for (int i = 0; i < count; i++)
+            {
+                if (list[i] == bestTriangle)
+                {
+                    list[i] = list[count - 1];
+                    break;
+                }
+            }
+            liveTriangles[v] = count - 1;
+        }
+
+        // New LRU cache: the triangle's vertices first, then the old entries
+        int newCount = 0;
+        for (int k = 0; k < 3; k++)
+            newCache[newCount++] = tri[k];
+        for (int i = 0; i < cacheCount; i++)
+        {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // Rescore everything that was or is in the cache
+        bestTriangle = -1;
+        bestScore = -1.0f;
+        for (int i = 0; i < newCount; i++)
+        {
+            uint32_t v = newCache[i];
+            int position = i < MESH_FORSYTH_CACHE_SIZE ? i : -1;
+            cachePosition[v] = position;
+            float score = meshForsythVertexScore(position, liveTriangles[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            const int *list = &adjacency[adjacencyOffsets[v]];
+            for (int j = 0; j < liveTriangles[v]; j++)
+            {
+                int t = list[j];
+                triangleScore[t] += delta;
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+        cacheCount = newCount < MESH_FORSYTH_CACHE_SIZE ? newCount : MESH_FORSYTH_CACHE_SIZE;
+        for (int i = 0; i < cacheCount; i++)
+            cache[i] = newCache[i];
+    }
+    indices.swap(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reorder vertices by first reference in the index buffer and remap the
+// indices, so the vertex fetch walks memory mostly forwards. Unreferenced
+// vertices are dropped.
+inline void meshOptimizeVertexFetch(IndexedMesh &mesh)
+{
+    const uint32_t unused = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+    {
+        uint32_t &index = mesh.indices[i];
+        if (remap[index] == unused)
+        {
+            remap[index] = (uint32_t)vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+// Triangle order within each subset of `indices` (offsets into it), or of
+// the whole list when there are none
+inline void meshOptimizeVertexCacheSubsets(std::vector<uint32_t> &indices, const MeshSubset *subsets, size_t subsetCount,
+                                           size_t vertexCount)
+{
+    if (subsetCount < 2)
+    {
+        meshOptimizeVertexCache(indices, vertexCount);
+        return;
+    }
+    std::vector<uint32_t> range;
+    for (size_t s = 0; s < subsetCount; s++)
+    {
+        std::vector<uint32_t>::iterator first = indices.begin() + subsets[s].indexOffset;
+        range.assign(first, first + subsets[s].indexCount);
+        meshOptimizeVertexCache(range, vertexCount);
+        std::copy(range.begin(), range.end(), first);
+    }
+}
+
+// Both passes, with before/after cache statistics. Triangles never move
+// between material subsets.
+inline void meshOptimize(IndexedMesh &mesh, VertexCacheStats *before = NULL, VertexCacheStats *after = NULL)
+{
+    if (before != NULL)
+        *before = meshAnalyzeVertexCache(mesh.indices, mesh.vertexCount());
+    meshOptimizeVertexCacheSubsets(mesh.indices, mesh.subsets.data(), mesh.subsetsPerLevel(), mesh.vertexCount());
+    meshOptimizeVertexFetch(mesh);
+    if (after != NULL)
+        *after = meshAnalyzeVertexCache(mesh.indices, mesh.vertexCount());
+}
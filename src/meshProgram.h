@@ -0,0 +1,210 @@
+#pragma once
+// meshProgram.h
+// GLSL 1.20 stand-in for the scene's fixed-function shading of meshes: light
+// 0 diffuse + ambient on gl_Color (colour material), two-sided since plants
+// are drawn without culling, modulated by texture unit 0. Compiled in
+// variants:
+//  - MESH_PROGRAM_INSTANCED: per-instance ground offset, scale, yaw and tint
+//    (GrassField), plus the mesh's local placement matrix
+//  - MESH_PROGRAM_QUANTIZED: QuantizedVertex input (meshQuantize.h); position
+//    and UV are scaled back by uniforms, the octahedral normal is decoded
+#include <cstdio>
+#include <string>
+#include "glee.h"
+#include "meshQuantize.h"
+
+const unsigned MESH_PROGRAM_INSTANCED = 1u << 0;
+const unsigned MESH_PROGRAM_QUANTIZED = 1u << 1;
+
+// Generic attribute slots clear of the ones NVIDIA aliases to gl_Normal,
+// gl_Color and gl_MultiTexCoord0 (1 would be the unused vertex weight)
+enum
+{
+    MESH_OCT_NORMAL_ATTRIB = 1,
+    MESH_INSTANCE_OFFSET_SCALE_ATTRIB = 6,
+    MESH_INSTANCE_YAW_COLOR_ATTRIB = 7
+};
+
+struct MeshProgram
+{
+    GLuint program = 0;
+    unsigned variant = 0;
+    GLint localMatrix = -1, shadowPass = -1, textured = -1, texture = -1;
+    GLint positionScale = -1, positionOffset = -1, uvScaleOffset = -1;
+};
+
+inline const char *meshProgramVertexSource()
+{
+    return "#ifdef MESH_INSTANCED\n"
+           "attribute vec4 instanceOffsetScale; // ground position, uniform scale\n"
+           "attribute vec4 instanceYawColor;    // yaw in radians, rgb tint\n"
+           "uniform mat4 localMatrix;           // ObjLoader rotate() + translate()\n"
+           "#endif\n"
+           "#ifdef MESH_QUANTIZED\n"
+           "attribute vec2 octNormal;\n"
+           "uniform vec3 positionScale;\n"
+           "uniform vec3 positionOffset;\n"
+           "uniform vec4 uvScaleOffset;\n"
+           "vec3 octDecode(vec2 e)\n"
+           "{\n"
+           "    e /= 32767.0;\n"
+           "    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+           "    if (n.z < 0.0)\n"
+           "        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+           "    return normalize(n);\n"
+           "}\n"
+           "#endif\n"
+           "uniform float shadowPass;\n"
+           "varying vec4 color;\n"
+           "void main()\n"
+           "{\n"
+           "#ifdef MESH_QUANTIZED\n"
+           "    vec4 position = vec4(gl_Vertex.xyz * positionScale + positionOffset, 1.0);\n"
+           "    vec3 normal = octDecode(octNormal);\n"
+           "    vec4 texcoord = vec4(gl_MultiTexCoord0.xy * uvScaleOffset.xy + uvScaleOffset.zw, 0.0, 1.0);\n"
+           "#else\n"
+           "    vec4 position = gl_Vertex;\n"
+           "    vec3 normal = gl_Normal;\n"
+           "    vec4 texcoord = gl_MultiTexCoord0;\n"
+           "#endif\n"
+           "#ifdef MESH_INSTANCED\n"
+           "    float s = sin(instanceYawColor.x), c = cos(instanceYawColor.x);\n"
+           "    mat3 yaw = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);\n"
+           "    vec3 local = (localMatrix * position).xyz;\n"
+           "    vec4 world = vec4(yaw * (local * instanceOffsetScale.w) + instanceOffsetScale.xyz, 1.0);\n"
+           "    normal = yaw * (mat3(localMatrix) * normal);\n"
+           "    vec4 tint = vec4(instanceYawColor.yzw, 1.0);\n"
+           "#else\n"
+           "    vec4 world = position;\n"
+           "    vec4 tint = vec4(1.0);\n"
+           "#endif\n"
+           "    gl_Position = gl_ModelViewProjectionMatrix * world;\n"
+           "    gl_TexCoord[0] = gl_TextureMatrix[0] * texcoord;\n"
+           "    if (shadowPass > 0.5) {\n"
+           "        color = gl_Color;\n"
+           "        return;\n"
+           "    }\n"
+           "    vec3 n = normalize(gl_NormalMatrix * normal);\n"
+           "    vec4 eye = gl_ModelViewMatrix * world;\n"
+           "    vec3 l = normalize(gl_LightSource[0].position.xyz - eye.xyz * gl_LightSource[0].position.w);\n"
+           "    float diffuse = abs(dot(n, l));\n"
+           "    vec4 base = tint * gl_Color;\n"
+           "    color = base * (gl_LightModel.ambient + gl_LightSource[0].ambient + diffuse * gl_LightSource[0].diffuse);\n"
+           "    color.a = base.a;\n"
+           "}\n";
+}
+
+inline const char *meshProgramFragmentSource()
+{
+    return "uniform sampler2D meshTexture;\n"
+           "uniform float textured;\n"
+           "varying vec4 color;\n"
+           "void main()\n"
+           "{\n"
+           "    gl_FragColor = textured > 0.5 ? color * texture2D(meshTexture, gl_TexCoord[0].xy) : color;\n"
+           "}\n";
+}
+
+inline GLuint meshCompileShader(GLenum type, const std::string &source, const char *owner)
+{
+    GLuint shader = glCreateShader(type);
+    const char *text = source.c_str();
+    glShaderSource(shader, 1, &text, NULL);
+    glCompileShader(shader);
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("%s: shader compile failed\n%s\n", owner, log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Build the requested variant; false (and program 0) if GLSL is unavailable
+// or the driver rejects it. `owner` prefixes the log messages.
+inline bool meshProgramCreate(MeshProgram &p, unsigned variant, const char *owner)
+{
+    p = MeshProgram();
+    p.variant = variant;
+    if (!GLEE_VERSION_2_0)
+        return false;
+    std::string header = "#version 120\n";
+    if (variant & MESH_PROGRAM_INSTANCED)
+        header += "#define MESH_INSTANCED 1\n";
+    if (variant & MESH_PROGRAM_QUANTIZED)
+        header += "#define MESH_QUANTIZED 1\n";
+    GLuint vertexShader = meshCompileShader(GL_VERTEX_SHADER, header + meshProgramVertexSource(), owner);
+    GLuint fragmentShader = meshCompileShader(GL_FRAGMENT_SHADER, header + meshProgramFragmentSource(), owner);
+    if (vertexShader == 0 || fragmentShader == 0)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+    p.program = glCreateProgram();
+    glAttachShader(p.program, vertexShader);
+    glAttachShader(p.program, fragmentShader);
+    if (variant & MESH_PROGRAM_INSTANCED)
+    {
+        glBindAttribLocation(p.program, MESH_INSTANCE_OFFSET_SCALE_ATTRIB, "instanceOffsetScale");
+        glBindAttribLocation(p.program, MESH_INSTANCE_YAW_COLOR_ATTRIB, "instanceYawColor");
+    }
+    if (variant & MESH_PROGRAM_QUANTIZED)
+        glBindAttribLocation(p.program, MESH_OCT_NORMAL_ATTRIB, "octNormal");
+    glLinkProgram(p.program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(p.program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        char log[1024];
+        glGetProgramInfoLog(p.program, sizeof(log), NULL, log);
+        printf("%s: shader link failed\n%s\n", owner, log);
+        glDeleteProgram(p.program);
+        p.program = 0;
+        return false;
+    }
+    p.localMatrix = glGetUniformLocation(p.program, "localMatrix");
+    p.shadowPass = glGetUniformLocation(p.program, "shadowPass");
+    p.textured = glGetUniformLocation(p.program, "textured");
+    p.texture = glGetUniformLocation(p.program, "meshTexture");
+    p.positionScale = glGetUniformLocation(p.program, "positionScale");
+    p.positionOffset = glGetUniformLocation(p.program, "positionOffset");
+    p.uvScaleOffset = glGetUniformLocation(p.program, "uvScaleOffset");
+    return true;
+}
+
+inline void meshProgramDelete(MeshProgram &p)
+{
+    if (p.program != 0)
+        glDeleteProgram(p.program);
+    p = MeshProgram();
+}
+
+// Make `p` current with the per-draw state; `quantization` is required for
+// the quantized variant and ignored otherwise
+inline void meshProgramBegin(const MeshProgram &p, int shadowMode, const QuantizationParams *quantization)
+{
+    glUseProgram(p.program);
+    glUniform1f(p.shadowPass, shadowMode != 0 ? 1.0f : 0.0f);
+    glUniform1f(p.textured, glIsEnabled(GL_TEXTURE_2D) && shadowMode == 0 ? 1.0f : 0.0f);
+    glUniform1i(p.texture, 0);
+    if ((p.variant & MESH_PROGRAM_QUANTIZED) && quantization != NULL)
+    {
+        glUniform3fv(p.positionScale, 1, quantization->positionScale);
+        glUniform3fv(p.positionOffset, 1, quantization->positionOffset);
+        glUniform4f(p.uvScaleOffset, quantization->uvScale[0], quantization->uvScale[1], quantization->uvOffset[0],
+                    quantization->uvOffset[1]);
+    }
+}
+
+inline void meshProgramEnd()
+{
+    glUseProgram(0);
+}
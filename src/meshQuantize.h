@@ -0,0 +1,179 @@
+#pragma once
+// meshQuantize.h
+// Compressed 16-byte vertex format for uploaded meshes, half of MeshVertex:
+//  - position: 3 x int16, normalised to the AABB per axis
+//  - texcoord: 2 x int16, normalised to the UV range
+//  - normal:   2 x int16, octahedral encoding
+// Values are stored as plain integers; position and UV are brought back by
+// a scale + offset (in the model/texture matrix or the shader) and the
+// normal is decoded in the vertex shader.
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "meshWeld.h"
+#include "meshBounds.h"
+
+const float MESH_QUANTIZE_RANGE = 32767.0f;
+
+struct QuantizedVertex
+{
+    int16_t px, py, pz, pad;
+    int16_t u, v;
+    int16_t octX, octY;
+};
+
+// value = stored * scale + offset
+struct QuantizationParams
+{
+    float positionScale[3];
+    float positionOffset[3];
+    float uvScale[2];
+    float uvOffset[2];
+};
+
+// Largest reconstruction error over all vertices, measured by the cooker
+struct QuantizationError
+{
+    float position; // model units (Euclidean)
+    float uv;       // texture units (per component)
+    float normal;   // degrees
+};
+
+struct QuantizedMesh
+{
+    std::vector<QuantizedVertex> vertices;
+    QuantizationParams params = QuantizationParams();
+    QuantizationError error = QuantizationError();
+
+    bool empty() const { return vertices.empty(); }
+    void clear() { vertices.clear(); }
+};
+
+inline int16_t meshQuantizeSnorm(float value)
+{
+    float scaled = value * MESH_QUANTIZE_RANGE;
+    scaled = scaled > MESH_QUANTIZE_RANGE ? MESH_QUANTIZE_RANGE : (scaled < -MESH_QUANTIZE_RANGE ? -MESH_QUANTIZE_RANGE : scaled);
+    return (int16_t)floorf(scaled + 0.5f);
+}
+
+// Octahedral mapping of a unit vector onto [-1, 1]^2
+inline void meshOctEncode(const float n[3], int16_t &x, int16_t &y)
+{
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    if (l1 <= 0.0f)
+    {
+        x = y = 0;
+        return;
+    }
+    float u = n[0] / l1, v = n[1] / l1;
+    if (n[2] < 0.0f)
+    {
+        float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    x = meshQuantizeSnorm(u);
+    y = meshQuantizeSnorm(v);
+}
+
+// Same math as the GLSL decode in meshProgram.h
+inline void meshOctDecode(int16_t x, int16_t y, float n[3])
+{
+    float u = x / MESH_QUANTIZE_RANGE, v = y / MESH_QUANTIZE_RANGE;
+    n[0] = u;
+    n[1] = v;
+    n[2] = 1.0f - fabsf(u) - fabsf(v);
+    if (n[2] < 0.0f)
+    {
+        n[0] = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        n[1] = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+    }
+    float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length > 0.0f)
+    {
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+}
+
+inline void meshDequantizeVertex(const QuantizedVertex &q, const QuantizationParams &p, MeshVertex &out)
+{
+    out.px = q.px * p.positionScale[0] + p.positionOffset[0];
+    out.py = q.py * p.positionScale[1] + p.positionOffset[1];
+    out.pz = q.pz * p.positionScale[2] + p.positionOffset[2];
+    out.u = q.u * p.uvScale[0] + p.uvOffset[0];
+    out.v = q.v * p.uvScale[1] + p.uvOffset[1];
+    float n[3];
+    meshOctDecode(q.octX, q.octY, n);
+    out.nx = n[0];
+    out.ny = n[1];
+    out.nz = n[2];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Quantize mesh.vertices (positions against `bounds`) into `out` and measure
+// the reconstruction error of every vertex
+inline void meshQuantize(const IndexedMesh &mesh, const MeshBounds &bounds, QuantizedMesh &out)
+{
+    size_t count = mesh.vertices.size();
+    QuantizationParams &p = out.params;
+    // UV range via the AABB helper on (u, v, nx); the third lane is unused
+    float uvMin[3] = {0.0f, 0.0f, 0.0f}, uvMax[3] = {0.0f, 0.0f, 0.0f};
+    if (count != 0)
+        meshComputeAabb(&mesh.vertices[0].u, count, sizeof(MeshVertex) / sizeof(float), uvMin, uvMax);
+    for (int k = 0; k < 3; k++)
+    {
+        float half = bounds.empty() ? 0.0f : (bounds.max[k] - bounds.min[k]) * 0.5f;
+        p.positionOffset[k] = bounds.empty() ? 0.0f : (bounds.max[k] + bounds.min[k]) * 0.5f;
+        p.positionScale[k] = half > 0.0f ? half / MESH_QUANTIZE_RANGE : 1.0f;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        float half = (uvMax[k] - uvMin[k]) * 0.5f;
+        p.uvOffset[k] = (uvMax[k] + uvMin[k]) * 0.5f;
+        p.uvScale[k] = half > 0.0f ? half / MESH_QUANTIZE_RANGE : 1.0f;
+    }
+
+    out.vertices.resize(count);
+    out.error.position = out.error.uv = out.error.normal = 0.0f;
+    double worstDot = 1.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const MeshVertex &v = mesh.vertices[i];
+        QuantizedVertex &q = out.vertices[i];
+        q.px = meshQuantizeSnorm((v.px - p.positionOffset[0]) / p.positionScale[0] / MESH_QUANTIZE_RANGE);
+        q.py = meshQuantizeSnorm((v.py - p.positionOffset[1]) / p.positionScale[1] / MESH_QUANTIZE_RANGE);
+        q.pz = meshQuantizeSnorm((v.pz - p.positionOffset[2]) / p.positionScale[2] / MESH_QUANTIZE_RANGE);
+        q.pad = 0;
+        q.u = meshQuantizeSnorm((v.u - p.uvOffset[0]) / p.uvScale[0] / MESH_QUANTIZE_RANGE);
+        q.v = meshQuantizeSnorm((v.v - p.uvOffset[1]) / p.uvScale[1] / MESH_QUANTIZE_RANGE);
+        float n[3] = {v.nx, v.ny, v.nz};
+        meshOctEncode(n, q.octX, q.octY);
+
+        MeshVertex d;
+        meshDequantizeVertex(q, p, d);
+        float dx = d.px - v.px, dy = d.py - v.py, dz = d.pz - v.pz;
+        float positionError = sqrtf(dx * dx + dy * dy + dz * dz);
+        float uvError = fmaxf(fabsf(d.u - v.u), fabsf(d.v - v.v));
+        out.error.position = positionError > out.error.position ? positionError : out.error.position;
+        out.error.uv = uvError > out.error.uv ? uvError : out.error.uv;
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f)
+        {
+            double dot = (d.nx * n[0] + d.ny * n[1] + d.nz * n[2]) / length;
+            worstDot = dot < worstDot ? dot : worstDot;
+        }
+    }
+    worstDot = worstDot > 1.0 ? 1.0 : (worstDot < -1.0 ? -1.0 : worstDot);
+    out.error.normal = (float)(acos(worstDot) * 57.29577951308232);
+}
+
+// Back to floats, e.g. after loading a quantized cooked file
+inline void meshDequantize(const QuantizedMesh &in, std::vector<MeshVertex> &out)
+{
+    out.resize(in.vertices.size());
+    for (size_t i = 0; i < in.vertices.size(); i++)
+        meshDequantizeVertex(in.vertices[i], in.params, out[i]);
+}
@@ -0,0 +1,473 @@
+#pragma once
+// meshSimplify.h
+// Quadric error metric (Garland & Heckbert) edge-collapse simplification and
+// LOD chain generation for IndexedMesh. Levels only produce new index lists;
+// they all share the original vertex buffer, so one VBO serves every LOD.
+//
+// Vertices are classified before collapsing:
+//  - manifold vertices may collapse onto any neighbour,
+//  - open-border vertices only slide along their border edges,
+//  - vertices on attribute seams (several welded vertices sharing one
+//    position, e.g. a UV seam) and non-manifold vertices are locked,
+// so texture seams and outlines survive every level.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "meshWeld.h"
+#include "meshOptimize.h"
+
+// Symmetric 4x4 error quadric (upper triangle) and the total weight of the
+// planes summed into it
+struct MeshQuadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double w;
+};
+
+inline void meshQuadricClear(MeshQuadric &q)
+{
+    q.a2 = q.ab = q.ac = q.ad = q.b2 = q.bc = q.bd = q.c2 = q.cd = q.d2 = q.w = 0.0;
+}
+
+// Plane ax + by + cz + d = 0 with unit normal, scaled by weight
+inline void meshQuadricAddPlane(MeshQuadric &q, double a, double b, double c, double d, double weight)
+{
+    q.a2 += weight * a * a;
+    q.ab += weight * a * b;
+    q.ac += weight * a * c;
+    q.ad += weight * a * d;
+    q.b2 += weight * b * b;
+    q.bc += weight * b * c;
+    q.bd += weight * b * d;
+    q.c2 += weight * c * c;
+    q.cd += weight * c * d;
+    q.d2 += weight * d * d;
+    q.w += weight;
+}
+
+inline void meshQuadricAdd(MeshQuadric &q, const MeshQuadric &r)
+{
+    q.a2 += r.a2;
+    q.ab += r.ab;
+    q.ac += r.ac;
+    q.ad += r.ad;
+    q.b2 += r.b2;
+    q.bc += r.bc;
+    q.bd += r.bd;
+    q.c2 += r.c2;
+    q.cd += r.cd;
+    q.d2 += r.d2;
+    q.w += r.w;
+}
+
+// Weighted mean squared distance of (x, y, z) to the planes
+inline double meshQuadricError(const MeshQuadric &q, double x, double y, double z)
+{
+    double e = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2 +
+               2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z + q.ad * x + q.bd * y + q.cd * z);
+    if (e <= 0.0 || q.w <= 0.0)
+        return 0.0;
+    return e / q.w;
+}
+
+enum MeshVertexKind
+{
+    MESH_VERTEX_MANIFOLD,
+    MESH_VERTEX_BORDER,
+    MESH_VERTEX_LOCKED
+};
+
+struct MeshCollapse
+{
+    float cost;
+    uint32_t source;
+    uint32_t target;
+    bool operator<(const MeshCollapse &other) const { return cost < other.cost; }
+};
+
+inline uint64_t meshEdgeKey(uint32_t a, uint32_t b) { return ((uint64_t)a << 32) | b; }
+
+// Open addressing multiset of directed edges
+struct MeshEdgeTable
+{
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> counts;
+    size_t mask = 0;
+
+    void reset(size_t edgeCount)
+    {
+        size_t capacity = 16;
+        while (capacity < edgeCount * 2)
+            capacity <<= 1;
+        keys.assign(capacity, ~(uint64_t)0);
+        counts.assign(capacity, 0);
+        mask = capacity - 1;
+    }
+    size_t find(uint64_t key) const
+    {
+        size_t slot = meshHashTriple((int)(key >> 32), (int)key, 0) & mask;
+        while (keys[slot] != key && keys[slot] != ~(uint64_t)0)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+    void add(uint64_t key)
+    {
+        size_t slot = find(key);
+        keys[slot] = key;
+        counts[slot]++;
+    }
+    uint32_t count(uint64_t key) const { return counts[find(key)]; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Simplify the triangle list `indices` (over mesh.vertices) down to about
+// targetIndexCount indices. Returns the largest collapse error taken, as an
+// RMS distance in model units. Vertices flagged in `locked` never move.
+// Surviving triangles keep their relative order; `triangleTags` (one per
+// input triangle) is compacted along with them.
+inline float meshSimplify(const IndexedMesh &mesh, const std::vector<uint32_t> &indices, size_t targetIndexCount,
+                          std::vector<uint32_t> &out, const std::vector<unsigned char> *locked = NULL,
+                          std::vector<uint32_t> *triangleTags = NULL)
+{
+    size_t vertexCount = mesh.vertices.size();
+    const MeshVertex *vertices = mesh.vertices.data();
+    out = indices;
+    if (out.size() <= targetIndexCount || vertexCount == 0)
+        return 0.0f;
+
+    // Position ids: welded vertices that share a position share an id
+    std::vector<uint32_t> positionId(vertexCount);
+    std::vector<uint32_t> positionUses;
+    {
+        size_t capacity = 16;
+        while (capacity < vertexCount * 2)
+            capacity <<= 1;
+        std::vector<uint32_t> slots(capacity, 0xFFFFFFFFu);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const MeshVertex &p = vertices[v];
+            uint32_t bits[3];
+            memcpy(bits, &p.px, sizeof(bits));
+            size_t slot = meshHashTriple((int)bits[0], (int)bits[1], (int)bits[2]) & (capacity - 1);
+            for (;;)
+            {
+                uint32_t other = slots[slot];
+                if (other == 0xFFFFFFFFu)
+                {
+                    slots[slot] = (uint32_t)v;
+                    positionId[v] = (uint32_t)positionUses.size();
+                    positionUses.push_back(1);
+                    break;
+                }
+                const MeshVertex &q = vertices[other];
+                if (q.px == p.px && q.py == p.py && q.pz == p.pz)
+                {
+                    positionId[v] = positionId[other];
+                    positionUses[positionId[v]]++;
+                    break;
+                }
+                slot = (slot + 1) & (capacity - 1);
+            }
+        }
+    }
+
+    std::vector<MeshQuadric> quadrics(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        meshQuadricClear(quadrics[v]);
+    std::vector<unsigned char> kind(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<unsigned char> touched(vertexCount);
+    std::vector<int> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    MeshEdgeTable edges;
+    std::vector<MeshCollapse> best(vertexCount);
+    std::vector<MeshCollapse> collapses;
+    double worstError = 0.0;
+
+    // Quadrics are accumulated once from the input and carried through collapses
+    for (size_t t = 0; t + 2 < out.size(); t += 3)
+    {
+        const MeshVertex &a = vertices[out[t]], &b = vertices[out[t + 1]], &c = vertices[out[t + 2]];
+        double e1[3] = {b.px - a.px, b.py - a.py, b.pz - a.pz};
+        double e2[3] = {c.px - a.px, c.py - a.py, c.pz - a.pz};
+        double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length <= 0.0)
+            continue;
+        n[0] /= length, n[1] /= length, n[2] /= length;
+        double d = -(n[0] * a.px + n[1] * a.py + n[2] * a.pz);
+        double area = length * 0.5;
+        for (int k = 0; k < 3; k++)
+            meshQuadricAddPlane(quadrics[out[t + k]], n[0], n[1], n[2], d, area);
+    }
+
+    for (int pass = 0; pass < 64 && out.size() > targetIndexCount; pass++)
+    {
+        size_t triangleCount = out.size() / 3;
+
+        // Directed edges by position; an edge whose reverse is missing is a border
+        edges.reset(out.size());
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                edges.add(meshEdgeKey(positionId[out[t * 3 + k]], positionId[out[t * 3 + (k + 1) % 3]]));
+
+        for (size_t v = 0; v < vertexCount; v++)
+            kind[v] = positionUses[positionId[v]] > 1 || (locked != NULL && (*locked)[v]) ? MESH_VERTEX_LOCKED
+                                                                                        : MESH_VERTEX_MANIFOLD;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = out[t * 3 + k], b = out[t * 3 + (k + 1) % 3];
+                uint32_t count = edges.count(meshEdgeKey(positionId[a], positionId[b]));
+                bool reverse = edges.count(meshEdgeKey(positionId[b], positionId[a])) != 0;
+                if (count > 1)
+                {
+                    kind[a] = kind[b] = MESH_VERTEX_LOCKED;
+                }
+                else if (!reverse)
+                {
+                    if (kind[a] == MESH_VERTEX_MANIFOLD)
+                        kind[a] = MESH_VERTEX_BORDER;
+                    if (kind[b] == MESH_VERTEX_MANIFOLD)
+                        kind[b] = MESH_VERTEX_BORDER;
+                    if (pass == 0)
+                    {
+                        // Keep the outline: a plane through the edge, perpendicular to the face
+                        const MeshVertex &pa = vertices[a], &pb = vertices[b], &pc = vertices[out[t * 3 + (k + 2) % 3]];
+                        double e[3] = {pb.px - pa.px, pb.py - pa.py, pb.pz - pa.pz};
+                        double f[3] = {pc.px - pa.px, pc.py - pa.py, pc.pz - pa.pz};
+                        double n[3] = {e[1] * f[2] - e[2] * f[1], e[2] * f[0] - e[0] * f[2], e[0] * f[1] - e[1] * f[0]};
+                        double p[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+                        double length = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                        if (length > 0.0)
+                        {
+                            p[0] /= length, p[1] /= length, p[2] /= length;
+                            double d = -(p[0] * pa.px + p[1] * pa.py + p[2] * pa.pz);
+                            double weight = 10.0 * (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+                            meshQuadricAddPlane(quadrics[a], p[0], p[1], p[2], d, weight);
+                            meshQuadricAddPlane(quadrics[b], p[0], p[1], p[2], d, weight);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Vertex -> triangle adjacency
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (size_t i = 0; i < out.size(); i++)
+            adjacencyOffsets[out[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(out.size());
+        {
+            std::vector<int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < out.size(); i++)
+                adjacency[fill[out[i]]++] = (uint32_t)(i / 3);
+        }
+
+        // Cheapest collapse of every vertex, then all of them cheapest first
+        for (size_t v = 0; v < vertexCount; v++)
+            best[v].source = 0xFFFFFFFFu;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = out[t * 3 + k], b = out[t * 3 + (k + 1) % 3];
+                for (int dir = 0; dir < 2; dir++)
+                {
+                    uint32_t source = dir == 0 ? a : b, target = dir == 0 ? b : a;
+                    if (kind[source] == MESH_VERTEX_LOCKED)
+                        continue;
+                    if (kind[source] == MESH_VERTEX_BORDER)
+                    {
+                        // Only along an actual border edge, onto a border (or locked) vertex
+                        if (kind[target] == MESH_VERTEX_MANIFOLD)
+                            continue;
+                        if (edges.count(meshEdgeKey(positionId[b], positionId[a])) != 0)
+                            continue;
+                    }
+                    MeshQuadric q = quadrics[source];
+                    meshQuadricAdd(q, quadrics[target]);
+                    const MeshVertex &p = vertices[target];
+                    float cost = (float)meshQuadricError(q, p.px, p.py, p.pz);
+                    if (best[source].source == 0xFFFFFFFFu || cost < best[source].cost)
+                    {
+                        best[source].cost = cost;
+                        best[source].source = source;
+                        best[source].target = target;
+                    }
+                }
+            }
+        }
+        collapses.clear();
+        for (size_t v = 0; v < vertexCount; v++)
+            if (best[v].source != 0xFFFFFFFFu)
+                collapses.push_back(best[v]);
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end());
+
+        // Apply independent collapses; each removes about two triangles
+        size_t wanted = (out.size() - targetIndexCount) / 6 + 1;
+        size_t applied = 0;
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = (uint32_t)v;
+        std::fill(touched.begin(), touched.end(), 0);
+        for (size_t c = 0; c < collapses.size() && applied < wanted; c++)
+        {
+            uint32_t source = collapses[c].source, target = collapses[c].target;
+            if (touched[source] || touched[target])
+                continue;
+
+            // Reject collapses that would flip or squash a neighbouring triangle
+            const MeshVertex &to = vertices[target];
+            bool flips = false;
+            for (int i = adjacencyOffsets[source]; i < adjacencyOffsets[source + 1] && !flips; i++)
+            {
+                const uint32_t *tri = &out[adjacency[i] * 3];
+                if (tri[0] == target || tri[1] == target || tri[2] == target)
+                    continue;
+                const MeshVertex *p[3], *q[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = &vertices[tri[k]];
+                    q[k] = tri[k] == source ? &to : p[k];
+                }
+                double n0[3], n1[3];
+                {
+                    double e1[3] = {p[1]->px - p[0]->px, p[1]->py - p[0]->py, p[1]->pz - p[0]->pz};
+                    double e2[3] = {p[2]->px - p[0]->px, p[2]->py - p[0]->py, p[2]->pz - p[0]->pz};
+                    n0[0] = e1[1] * e2[2] - e1[2] * e2[1], n0[1] = e1[2] * e2[0] - e1[0] * e2[2], n0[2] = e1[0] * e2[1] - e1[1] * e2[0];
+                }
+                {
+                    double e1[3] = {q[1]->px - q[0]->px, q[1]->py - q[0]->py, q[1]->pz - q[0]->pz};
+                    double e2[3] = {q[2]->px - q[0]->px, q[2]->py - q[0]->py, q[2]->pz - q[0]->pz};
+                    n1[0] = e1[1] * e2[2] - e1[2] * e2[1], n1[1] = e1[2] * e2[0] - e1[0] * e2[2], n1[2] = e1[0] * e2[1] - e1[1] * e2[0];
+                }
+                double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+                double lengths = sqrt((n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]) * (n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]));
+                flips = dot <= 0.25 * lengths;
+            }
+            if (flips)
+                continue;
+
+            remap[source] = target;
+            meshQuadricAdd(quadrics[target], quadrics[source]);
+            if (collapses[c].cost > worstError)
+                worstError = collapses[c].cost;
+            // Freeze the whole neighbourhood so later collapses in this pass
+            // see up-to-date geometry
+            for (int i = adjacencyOffsets[source]; i < adjacencyOffsets[source + 1]; i++)
+            {
+                const uint32_t *tri = &out[adjacency[i] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+            applied++;
+        }
+        if (applied == 0)
+            break;
+
+        // Rewrite the index list and drop collapsed triangles
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            uint32_t a = remap[out[t * 3]], b = remap[out[t * 3 + 1]], c = remap[out[t * 3 + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            if (triangleTags != NULL)
+                (*triangleTags)[write / 3] = (*triangleTags)[t];
+            out[write++] = a;
+            out[write++] = b;
+            out[write++] = c;
+        }
+        out.resize(write);
+        if (triangleTags != NULL)
+            triangleTags->resize(write / 3);
+    }
+    return (float)sqrt(worstError);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Build up to maxLevels levels (including the full mesh as level 0), each
+// about half the triangles of the previous one, into mesh.lods and
+// mesh.lodIndices. Stops early once a level no longer shrinks much or falls
+// under minTriangles. Run after meshOptimize(): vertex fetch reordering only
+// remaps `indices`. Material subsets are simplified together, with the
+// vertices they share locked so their boundaries stay closed, and every
+// level gets the same subsets in the same order.
+inline void meshBuildLodChain(IndexedMesh &mesh, int maxLevels = 6, size_t minTriangles = 64)
+{
+    size_t subsetCount = mesh.subsetsPerLevel();
+    mesh.subsets.resize(subsetCount);
+    mesh.lods.clear();
+    mesh.lodIndices.clear();
+    MeshLod full;
+    full.indexOffset = 0;
+    full.indexCount = (uint32_t)mesh.indices.size();
+    full.error = 0.0f;
+    mesh.lods.push_back(full);
+
+    // Subset of every triangle, and the vertices used by more than one subset
+    std::vector<uint32_t> tags, levelTags;
+    std::vector<unsigned char> locked;
+    if (subsetCount != 0)
+    {
+        tags.resize(mesh.triangleCount());
+        const uint32_t unused = 0xFFFFFFFFu;
+        std::vector<uint32_t> owner(mesh.vertices.size(), unused);
+        locked.assign(mesh.vertices.size(), 0);
+        for (size_t s = 0; s < subsetCount; s++)
+        {
+            const MeshSubset &subset = mesh.subsets[s];
+            for (uint32_t i = subset.indexOffset; i < subset.indexOffset + subset.indexCount; i++)
+            {
+                tags[i / 3] = (uint32_t)s;
+                uint32_t v = mesh.indices[i];
+                if (owner[v] != unused && owner[v] != s)
+                    locked[v] = 1;
+                owner[v] = (uint32_t)s;
+            }
+        }
+    }
+
+    std::vector<uint32_t> previous = mesh.indices;
+    std::vector<uint32_t> level;
+    std::vector<MeshSubset> levelSubsets(subsetCount);
+    float error = 0.0f;
+    while ((int)mesh.lods.size() < maxLevels && previous.size() / 3 > minTriangles * 2)
+    {
+        levelTags = tags;
+        float levelError = meshSimplify(mesh, previous, previous.size() / 2, level, subsetCount != 0 ? &locked : NULL,
+                                        subsetCount != 0 ? &levelTags : NULL);
+        if (level.size() > previous.size() * 9 / 10)
+            break;
+        // Tags stay sorted, so each subset is still one run
+        for (size_t s = 0, t = 0; s < subsetCount; s++)
+        {
+            levelSubsets[s] = mesh.subsets[s];
+            levelSubsets[s].indexOffset = (uint32_t)(t * 3);
+            while (t < levelTags.size() && levelTags[t] == s)
+                t++;
+            levelSubsets[s].indexCount = (uint32_t)(t * 3) - levelSubsets[s].indexOffset;
+        }
+        meshOptimizeVertexCacheSubsets(level, levelSubsets.data(), subsetCount, mesh.vertices.size());
+        error += levelError; // levels are built from each other, so errors add up
+
+        MeshLod lod;
+        lod.indexOffset = (uint32_t)(mesh.indices.size() + mesh.lodIndices.size());
+        lod.indexCount = (uint32_t)level.size();
+        lod.error = error;
+        mesh.lods.push_back(lod);
+        for (size_t s = 0; s < subsetCount; s++)
+        {
+            levelSubsets[s].indexOffset += lod.indexOffset;
+            mesh.subsets.push_back(levelSubsets[s]);
+        }
+        mesh.lodIndices.insert(mesh.lodIndices.end(), level.begin(), level.end());
+        previous.swap(level);
+        tags.swap(levelTags);
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+// meshTriangulate.h
+// Load-time triangulation of OBJ polygons. Convex faces are split as a fan,
+// concave ones by ear clipping in the polygon's dominant plane. Afterwards
+// every face of the ObjMeshData is a triangle.
+#include <cmath>
+#include <vector>
+#include "objParser.h"
+
+struct TriangulateStats
+{
+    size_t polygons = 0;  // faces with more than 3 corners
+    size_t concave = 0;   // of those, ear clipped
+    size_t dropped = 0;   // faces with fewer than 3 corners
+};
+
+inline float meshCross2(const float *o, const float *a, const float *b)
+{
+    return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+// True if p lies inside or on triangle abc (counter-clockwise)
+inline bool meshPointInTriangle2(const float *p, const float *a, const float *b, const float *c)
+{
+    return meshCross2(a, b, p) >= 0.0f && meshCross2(b, c, p) >= 0.0f && meshCross2(c, a, p) >= 0.0f;
+}
+
+// Triangulate one polygon given its corner positions (3 floats each).
+// Writes corner-local index triples (0..n-1) to `out`; returns true if the
+// polygon was concave and needed ear clipping.
+inline bool meshTriangulatePolygon(const std::vector<const float *> &points, std::vector<int> &out,
+                                   std::vector<float> &scratch2d, std::vector<int> &scratchRing)
+{
+    int n = (int)points.size();
+
+    // Newell normal picks the projection plane
+    float normal[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < n; i++)
+    {
+        const float *a = points[i];
+        const float *b = points[(i + 1) % n];
+        normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+        normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+        normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+    float ax = fabsf(normal[0]), ay = fabsf(normal[1]), az = fabsf(normal[2]);
+    int u = 0, v = 1;
+    float sign = normal[2];
+    if (ax >= ay && ax >= az)
+    {
+        u = 1, v = 2, sign = normal[0];
+    }
+    else if (ay >= az)
+    {
+        u = 2, v = 0, sign = normal[1];
+    }
+
+    // Project, flipping so the polygon winds counter-clockwise in 2D
+    scratch2d.resize(n * 2);
+    for (int i = 0; i < n; i++)
+    {
+        scratch2d[i * 2 + 0] = points[i][u];
+        scratch2d[i * 2 + 1] = sign < 0.0f ? -points[i][v] : points[i][v];
+    }
+    const float *p2 = scratch2d.data();
+
+    bool convex = true;
+    for (int i = 0; i < n && convex; i++)
+        if (meshCross2(&p2[i * 2], &p2[((i + 1) % n) * 2], &p2[((i + 2) % n) * 2]) < 0.0f)
+            convex = false;
+    if (convex)
+    {
+        for (int i = 1; i + 1 < n; i++)
+        {
+            out.push_back(0);
+            out.push_back(i);
+            out.push_back(i + 1);
+        }
+        return false;
+    }
+
+    // Ear clipping over a ring of remaining corners
+    scratchRing.resize(n);
+    for (int i = 0; i < n; i++)
+        scratchRing[i] = i;
+    int remaining = n;
+    int guard = 0;
+    int i = 0;
+    while (remaining > 3 && guard < remaining)
+    {
+        int prev = scratchRing[(i + remaining - 1) % remaining];
+        int cur = scratchRing[i % remaining];
+        int next = scratchRing[(i + 1) % remaining];
+        const float *a = &p2[prev * 2], *b = &p2[cur * 2], *c = &p2[next * 2];
+        bool ear = meshCross2(a, b, c) > 0.0f;
+        for (int k = 0; ear && k < remaining; k++)
+        {
+            int q = scratchRing[k];
+            if (q != prev && q != cur && q != next && meshPointInTriangle2(&p2[q * 2], a, b, c))
+                ear = false;
+        }
+        if (ear)
+        {
+            out.push_back(prev);
+            out.push_back(cur);
+            out.push_back(next);
+            scratchRing.erase(scratchRing.begin() + (i % remaining));
+            remaining--;
+            guard = 0;
+            if (i >= remaining)
+                i = 0;
+        }
+        else
+        {
+            i = (i + 1) % remaining;
+            guard++;
+        }
+    }
+    // Whatever is left (a triangle, or a degenerate ring with no ear) is fanned
+    for (int k = 1; k + 1 < remaining; k++)
+    {
+        out.push_back(scratchRing[0]);
+        out.push_back(scratchRing[k]);
+        out.push_back(scratchRing[k + 1]);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Rewrite the faces of `mesh` as triangles. Meshes that are already all
+// triangles are left untouched. Material and group runs follow their faces.
+inline TriangulateStats meshTriangulate(ObjMeshData &mesh)
+{
+    TriangulateStats stats;
+    size_t faceCount = mesh.faceCount();
+    bool allTriangles = true;
+    for (size_t f = 0; f < faceCount && allTriangles; f++)
+        allTriangles = mesh.faceOffsets[f + 1] - mesh.faceOffsets[f] == 3;
+    if (allTriangles)
+        return stats;
+
+    std::vector<int> faceOffsets, cornerV, cornerVT, cornerVN;
+    std::vector<int> firstTriangle(faceCount + 1); // new face index of each old face
+    faceOffsets.reserve(faceCount + 1);
+    cornerV.reserve(mesh.cornerCount() * 2);
+    cornerVT.reserve(mesh.cornerCount() * 2);
+    cornerVN.reserve(mesh.cornerCount() * 2);
+    faceOffsets.push_back(0);
+
+    std::vector<const float *> points;
+    std::vector<int> local;
+    std::vector<float> scratch2d;
+    std::vector<int> scratchRing;
+    static const float origin[3] = {0.0f, 0.0f, 0.0f};
+    int positionCount = (int)mesh.positionCount();
+
+    for (size_t f = 0; f < faceCount; f++)
+    {
+        firstTriangle[f] = (int)faceOffsets.size() - 1;
+        int first = mesh.faceOffsets[f];
+        int n = mesh.faceOffsets[f + 1] - first;
+        if (n < 3)
+        {
+            stats.dropped++;
+            continue;
+        }
+        local.clear();
+        if (n == 3)
+        {
+            local.push_back(0);
+            local.push_back(1);
+            local.push_back(2);
+        }
+        else
+        {
+            stats.polygons++;
+            points.resize(n);
+            for (int k = 0; k < n; k++)
+            {
+                int v = mesh.cornerV[first + k];
+                points[k] = v >= 0 && v < positionCount ? &mesh.positions[v * 3] : origin;
+            }
+            if (meshTriangulatePolygon(points, local, scratch2d, scratchRing))
+                stats.concave++;
+        }
+        for (size_t k = 0; k < local.size(); k += 3)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                int c = first + local[k + j];
+                cornerV.push_back(mesh.cornerV[c]);
+                cornerVT.push_back(mesh.cornerVT[c]);
+                cornerVN.push_back(mesh.cornerVN[c]);
+            }
+            faceOffsets.push_back((int)cornerV.size());
+        }
+    }
+
+    firstTriangle[faceCount] = (int)faceOffsets.size() - 1;
+    std::vector<ObjFaceRun> *runLists[2] = {&mesh.materialRuns, &mesh.groupRuns};
+    for (int l = 0; l < 2; l++)
+    {
+        std::vector<ObjFaceRun> runs;
+        runs.swap(*runLists[l]);
+        for (size_t r = 0; r < runs.size(); r++)
+            objAddRun(*runLists[l], firstTriangle[runs[r].firstFace], runs[r].index);
+    }
+
+    mesh.faceOffsets.swap(faceOffsets);
+    mesh.cornerV.swap(cornerV);
+    mesh.cornerVT.swap(cornerVT);
+    mesh.cornerVN.swap(cornerVN);
+    return stats;
+}
@@ -0,0 +1,209 @@
+#pragma once
+// meshWeld.h
+// Turns the separately indexed v/vt/vn corners of an OBJ into one vertex
+// stream and one 32-bit triangle index buffer, which is what
+// glDrawElements and the post-transform vertex cache need. Triangles are
+// sorted by usemtl material, so each material is one contiguous draw range.
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "objParser.h"
+
+// Interleaved vertex: position, texcoord, normal (32 bytes)
+struct MeshVertex
+{
+    float px, py, pz;
+    float u, v;
+    float nx, ny, nz;
+};
+
+// One level of detail: a range of the index buffer as uploaded, which is
+// `indices` followed by `lodIndices`
+struct MeshLod
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error; // simplification error in model units (0 for the full mesh)
+};
+
+// The triangles of one material within a level, as an uploaded index range
+struct MeshSubset
+{
+    uint32_t indexOffset;
+    uint32_t indexCount; // may be 0 in coarse levels
+    int32_t material;    // into IndexedMesh::materials; -1 for faces before any usemtl
+};
+
+struct IndexedMesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;    // triangle list, full detail
+    std::vector<MeshLod> lods;        // empty, or lods[0] covering `indices`
+    std::vector<uint32_t> lodIndices; // triangle lists of lods[1..], back to back
+    std::vector<MeshSubset> subsets;  // empty, or the same materials in order for every level, level after level
+    std::vector<std::string> materials;         // usemtl names
+    std::vector<std::string> materialLibraries; // mtllib file names as written in the OBJ
+
+    size_t vertexCount() const { return vertices.size(); }
+    size_t triangleCount() const { return indices.size() / 3; }
+    size_t drawIndexCount() const { return indices.size() + lodIndices.size(); }
+    size_t levelCount() const { return lods.empty() ? 1 : lods.size(); }
+    size_t subsetsPerLevel() const { return subsets.size() / levelCount(); }
+    // The subsets of one level (none when the OBJ has no usemtl)
+    const MeshSubset *levelSubsets(size_t level) const { return subsets.data() + level * subsetsPerLevel(); }
+
+    size_t memoryFootprint() const
+    {
+        size_t names = 0;
+        for (size_t i = 0; i < materials.size(); i++)
+            names += materials[i].capacity();
+        for (size_t i = 0; i < materialLibraries.size(); i++)
+            names += materialLibraries[i].capacity();
+        return vertices.capacity() * sizeof(MeshVertex) + indices.capacity() * sizeof(uint32_t) +
+               lods.capacity() * sizeof(MeshLod) + lodIndices.capacity() * sizeof(uint32_t) +
+               subsets.capacity() * sizeof(MeshSubset) + names;
+    }
+
+    void clear()
+    {
+        vertices.clear();
+        indices.clear();
+        lods.clear();
+        lodIndices.clear();
+        subsets.clear();
+        materials.clear();
+        materialLibraries.clear();
+    }
+};
+
+inline uint32_t meshHashTriple(int a, int b, int c)
+{
+    uint32_t h = (uint32_t)a * 0x9E3779B1u;
+    h ^= (uint32_t)b * 0x85EBCA77u + (h << 6) + (h >> 2);
+    h ^= (uint32_t)c * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Weld every triangle of `data` into `out`. Each unique (v, vt, vn) triple
+// becomes one vertex. Run meshTriangulate() first: faces that are not
+// triangles are skipped. A missing vt
+// gives uv (0, 0) and a missing vn gives a zero normal. With usemtl in the
+// OBJ the triangles come out grouped by material (stable within each), with
+// one subset per material used.
+inline void meshWeld(const ObjMeshData &data, IndexedMesh &out)
+{
+    out.clear();
+    if (data.positionCount() == 0)
+        return;
+    size_t faceCount = data.faceCount();
+    out.materials = data.materialNames;
+    out.materialLibraries = data.materialLibraries;
+
+    // Face order: counting sort by material, slot 0 for faces without one
+    std::vector<uint32_t> order;
+    std::vector<size_t> materialStart;
+    if (!data.materialRuns.empty())
+    {
+        std::vector<int> faceMaterial;
+        objExpandRuns(data.materialRuns, faceCount, faceMaterial);
+        materialStart.assign(data.materialNames.size() + 2, 0);
+        for (size_t f = 0; f < faceCount; f++)
+            if (data.faceOffsets[f + 1] - data.faceOffsets[f] == 3)
+                materialStart[faceMaterial[f] + 2]++;
+        for (size_t m = 1; m < materialStart.size(); m++)
+            materialStart[m] += materialStart[m - 1];
+        order.resize(materialStart.back());
+        std::vector<size_t> fill(materialStart.begin(), materialStart.end() - 1);
+        for (size_t f = 0; f < faceCount; f++)
+            if (data.faceOffsets[f + 1] - data.faceOffsets[f] == 3)
+                order[fill[faceMaterial[f] + 1]++] = (uint32_t)f;
+        for (size_t m = 0; m + 1 < materialStart.size(); m++)
+        {
+            if (materialStart[m + 1] == materialStart[m])
+                continue;
+            MeshSubset subset = {(uint32_t)(materialStart[m] * 3), (uint32_t)((materialStart[m + 1] - materialStart[m]) * 3),
+                                 (int32_t)m - 1};
+            out.subsets.push_back(subset);
+        }
+    }
+
+    // Open addressing table, at least twice the corner count so probes stay short
+    size_t capacity = 16;
+    while (capacity < faceCount * 3 * 2)
+        capacity <<= 1;
+    const uint32_t empty = 0xFFFFFFFFu;
+    std::vector<uint32_t> slots(capacity, empty);
+    std::vector<int> keys; // v, vt, vn of each output vertex
+    size_t mask = capacity - 1;
+
+    out.indices.reserve(faceCount * 3);
+    out.vertices.reserve(data.positionCount());
+    keys.reserve(data.positionCount() * 3);
+
+    const float *positions = data.positions.data();
+    const float *texcoords = data.texcoords.data();
+    const float *normals = data.normals.data();
+    int positionCount = (int)data.positionCount();
+    int texcoordCount = (int)data.texcoordCount();
+    int normalCount = (int)data.normalCount();
+
+    size_t weldCount = order.empty() ? faceCount : order.size();
+    for (size_t i = 0; i < weldCount; i++)
+    {
+        size_t f = order.empty() ? i : order[i];
+        int first = data.faceOffsets[f];
+        if (data.faceOffsets[f + 1] - first != 3)
+            continue;
+        for (int c = first; c < first + 3; c++)
+        {
+            int v = data.cornerV[c];
+            int vt = data.cornerVT[c];
+            int vn = data.cornerVN[c];
+            if (v < 0 || v >= positionCount)
+                v = 0;
+            if (vt < 0 || vt >= texcoordCount)
+                vt = -1;
+            if (vn < 0 || vn >= normalCount)
+                vn = -1;
+
+            size_t slot = meshHashTriple(v, vt, vn) & mask;
+            for (;;)
+            {
+                uint32_t index = slots[slot];
+                if (index == empty)
+                {
+                    index = (uint32_t)out.vertices.size();
+                    slots[slot] = index;
+                    keys.push_back(v);
+                    keys.push_back(vt);
+                    keys.push_back(vn);
+
+                    MeshVertex vertex;
+                    vertex.px = positions[v * 3 + 0];
+                    vertex.py = positions[v * 3 + 1];
+                    vertex.pz = positions[v * 3 + 2];
+                    vertex.u = vt >= 0 ? texcoords[vt * 2 + 0] : 0.0f;
+                    vertex.v = vt >= 0 ? texcoords[vt * 2 + 1] : 0.0f;
+                    vertex.nx = vn >= 0 ? normals[vn * 3 + 0] : 0.0f;
+                    vertex.ny = vn >= 0 ? normals[vn * 3 + 1] : 0.0f;
+                    vertex.nz = vn >= 0 ? normals[vn * 3 + 2] : 0.0f;
+                    out.vertices.push_back(vertex);
+                    out.indices.push_back(index);
+                    break;
+                }
+                const int *key = &keys[index * 3];
+                if (key[0] == v && key[1] == vt && key[2] == vn)
+                {
+                    out.indices.push_back(index);
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+        }
+    }
+    out.vertices.shrink_to_fit();
+}
@@ -0,0 +1,174 @@
+// meshletBench.cpp
+// Standalone meshlet culling benchmark; needs no window or GL context.
+//   meshletBench <file.obj> [views]
+// Loads the OBJ the way ObjLoader does (parse, triangulate, weld, optimise),
+// builds meshlets, then culls them from a ring of views around the mesh
+// (whole mesh in view: back-face rejection) and a ring of close-ups just
+// outside the bounding sphere (most meshlets off screen: frustum rejection).
+// Prints per view the fraction of triangles rejected and checks that no
+// rejected triangle could be visible.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "objParser.h"
+#include "meshWeld.h"
+#include "meshTriangulate.h"
+#include "meshNormals.h"
+#include "meshOptimize.h"
+#include "meshlets.h"
+
+using namespace std;
+
+static void perspective(float fovY, float aspect, float zNear, float zFar, float m[16])
+{
+    float f = 1.0f / tanf(fovY * 0.5f * 3.14159265f / 180.0f);
+    for (int i = 0; i < 16; i++)
+        m[i] = 0.0f;
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zFar + zNear) / (zNear - zFar);
+    m[11] = -1.0f;
+    m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+}
+
+// gluLookAt with an up vector of +y
+static void lookAt(const float eye[3], const float at[3], float m[16])
+{
+    float f[3] = {at[0] - eye[0], at[1] - eye[1], at[2] - eye[2]};
+    float fl = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    for (int k = 0; k < 3; k++)
+        f[k] /= fl;
+    float s[3] = {-f[2], 0.0f, f[0]}; // f x (0, 1, 0)
+    float sl = sqrtf(s[0] * s[0] + s[2] * s[2]);
+    s[0] /= sl;
+    s[2] /= sl;
+    float u[3] = {s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0]};
+    float rows[3][3] = {{s[0], s[1], s[2]}, {u[0], u[1], u[2]}, {-f[0], -f[1], -f[2]}};
+    for (int c = 0; c < 3; c++)
+        for (int r = 0; r < 3; r++)
+            m[c * 4 + r] = rows[r][c];
+    for (int r = 0; r < 3; r++)
+        m[12 + r] = -(rows[r][0] * eye[0] + rows[r][1] * eye[1] + rows[r][2] * eye[2]);
+    m[3] = m[7] = m[11] = 0.0f;
+    m[15] = 1.0f;
+}
+
+// A rejected meshlet must not contain a triangle that is front-facing and
+// has a corner inside the frustum
+static size_t countWrongRejections(const IndexedMesh &mesh, const vector<Meshlet> &meshlets, const MeshletView &view)
+{
+    size_t wrong = 0;
+    for (size_t i = 0; i < meshlets.size(); i++)
+    {
+        const Meshlet &m = meshlets[i];
+        int result = meshCullMeshlet(m, view);
+        for (uint32_t t = m.indexOffset; result != 0 && t < m.indexOffset + m.indexCount; t += 3)
+        {
+            const MeshVertex *v[3] = {&mesh.vertices[mesh.indices[t]], &mesh.vertices[mesh.indices[t + 1]],
+                                      &mesh.vertices[mesh.indices[t + 2]]};
+            if (result == 1)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    bool inside = true;
+                    for (int p = 0; p < 6; p++)
+                    {
+                        const float *pl = view.planes[p];
+                        inside = inside && pl[0] * v[c]->px + pl[1] * v[c]->py + pl[2] * v[c]->pz + pl[3] >= -1e-4f;
+                    }
+                    wrong += inside;
+                }
+            }
+            else
+            {
+                float e1[3] = {v[1]->px - v[0]->px, v[1]->py - v[0]->py, v[1]->pz - v[0]->pz};
+                float e2[3] = {v[2]->px - v[0]->px, v[2]->py - v[0]->py, v[2]->pz - v[0]->pz};
+                float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+                float toEye[3] = {view.eye[0] - v[0]->px, view.eye[1] - v[0]->py, view.eye[2] - v[0]->pz};
+                wrong += n[0] * toEye[0] + n[1] * toEye[1] + n[2] * toEye[2] > 1e-6f;
+            }
+        }
+    }
+    return wrong;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: meshletBench <file.obj> [views]\n");
+        return 1;
+    }
+    int views = argc > 2 ? atoi(argv[2]) : 8;
+    ObjMeshData data;
+    ObjParseStats parseStats;
+    if (!objParseFile(argv[1], data, &parseStats, 0))
+    {
+        printf("Error opening file!\n");
+        return 1;
+    }
+    meshTriangulate(data);
+    meshGenerateNormals(data);
+    IndexedMesh mesh;
+    meshWeld(data, mesh);
+    meshOptimize(mesh);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<Meshlet> meshlets;
+    meshBuildMeshlets(mesh, meshlets);
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double radiusSum = 0.0;
+    size_t cones = 0;
+    for (size_t i = 0; i < meshlets.size(); i++)
+    {
+        radiusSum += meshlets[i].radius;
+        cones += meshlets[i].coneCutoff <= 1.0f;
+    }
+    MeshBounds bounds = meshComputeBounds(&mesh.vertices[0].px, mesh.vertexCount(), sizeof(MeshVertex) / sizeof(float));
+    printf("%s: %zu vertices, %zu triangles -> %zu meshlets (%.1f triangles each) in %.2f ms\n", argv[1],
+           mesh.vertexCount(), mesh.triangleCount(), meshlets.size(), mesh.triangleCount() / (double)meshlets.size(), buildMs);
+    printf("mean meshlet radius %.3f%% of the mesh radius, %.1f%% with a usable normal cone\n\n",
+           100.0 * radiusSum / meshlets.size() / bounds.radius, 100.0 * cones / meshlets.size());
+
+    float projection[16], modelview[16];
+    perspective(45.0f, 4.0f / 3.0f, bounds.radius * 0.01f, bounds.radius * 10.0f, projection);
+    printf("view        meshlets  frustum  backface  triangles rejected  cull us  wrong\n");
+    double fractionSum[2] = {0.0, 0.0};
+    size_t wrongTotal = 0;
+    for (int ring = 0; ring < 2; ring++)
+    {
+        for (int v = 0; v < views; v++)
+        {
+            // Both rings look at the centre, from 2.5 and 1.2 radii
+            float angle = 6.2831853f * v / views;
+            float distance = bounds.radius * (ring == 0 ? 2.5f : 1.2f);
+            float dir[3] = {cosf(angle) * 0.9f, 0.44f, sinf(angle) * 0.9f};
+            float eye[3], at[3];
+            for (int k = 0; k < 3; k++)
+            {
+                eye[k] = bounds.center[k] + dir[k] * distance;
+                at[k] = bounds.center[k];
+            }
+            lookAt(eye, at, modelview);
+            MeshletView view = meshMeshletView(modelview, projection, true);
+            vector<MeshletRange> visible;
+            MeshletCullStats stats;
+            const int repeats = 20;
+            start = chrono::steady_clock::now();
+            for (int r = 0; r < repeats; r++)
+                meshCullMeshlets(meshlets, view, visible, stats);
+            double cullUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / repeats;
+            size_t wrong = countWrongRejections(mesh, meshlets, view);
+            wrongTotal += wrong;
+            fractionSum[ring] += stats.rejectedFraction();
+            printf("%-8s%3d  %8zu  %7zu  %8zu  %8.1f%% (%zu)  %7.1f  %5zu\n", ring == 0 ? "orbit" : "close", v,
+                   stats.meshlets, stats.frustumRejected, stats.backfaceRejected, 100.0 * stats.rejectedFraction(),
+                   stats.trianglesRejected, cullUs, wrong);
+        }
+    }
+    printf("\nmean triangles rejected: orbit %.1f%%, close %.1f%%; %zu wrongly rejected triangles\n",
+           100.0 * fractionSum[0] / views, 100.0 * fractionSum[1] / views, wrongTotal);
+    return wrongTotal == 0 ? 0 : 2;
+}
@@ -0,0 +1,275 @@
+#pragma once
+// meshlets.h
+// Splits the full-detail triangle list into meshlets of at most 64 vertices
+// and 124 triangles, each with a bounding sphere and a normal cone, and
+// culls them on the CPU against the view frustum and for facing away from
+// the eye. A meshlet is a run of consecutive triangles of
+// IndexedMesh::indices; after meshOptimize() that order is already local, so
+// the survivors are drawn straight from the existing index buffer (or the
+// flat-shading stream, which has the same triangle order). Meshlets never
+// span two material subsets.
+// No GL calls here: the view comes in as plain matrices.
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "meshWeld.h"
+#include "meshBounds.h"
+
+const unsigned MESHLET_MAX_VERTICES = 64;
+const unsigned MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+    uint32_t indexOffset; // into IndexedMesh::indices
+    uint32_t indexCount;
+    float center[3]; // bounding sphere
+    float radius;
+    float coneAxis[3]; // average facing of the triangles
+    float coneCutoff;  // sin of the cone's half angle; > 1 when it can't be back-facing
+};
+
+// A merged run of visible meshlets
+struct MeshletRange
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+};
+
+struct MeshletCullStats
+{
+    size_t meshlets = 0;
+    size_t frustumRejected = 0;
+    size_t backfaceRejected = 0;
+    size_t triangles = 0;
+    size_t trianglesRejected = 0;
+
+    float rejectedFraction() const { return triangles != 0 ? (float)trianglesRejected / triangles : 0.0f; }
+};
+
+// The view in model space
+struct MeshletView
+{
+    float planes[6][4]; // inside when dot(xyz, p) + w >= 0
+    float eye[3];       // perspective: eye position
+    float viewDir[3];   // orthographic: viewing direction
+    bool perspective;
+    bool backfaceCull;  // back faces are culled and the winding is not mirrored
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Bounding sphere and normal cone of indices[begin, end)
+inline void meshFinishMeshlet(const IndexedMesh &mesh, const std::vector<uint32_t> &unique, size_t begin, size_t end,
+                              std::vector<float> &scratch, Meshlet &m)
+{
+    m.indexOffset = (uint32_t)begin;
+    m.indexCount = (uint32_t)(end - begin);
+    scratch.resize(unique.size() * 3);
+    for (size_t i = 0; i < unique.size(); i++)
+    {
+        const MeshVertex &v = mesh.vertices[unique[i]];
+        scratch[i * 3] = v.px;
+        scratch[i * 3 + 1] = v.py;
+        scratch[i * 3 + 2] = v.pz;
+    }
+    MeshBounds b = meshComputeBounds(scratch.data(), unique.size());
+    for (int k = 0; k < 3; k++)
+        m.center[k] = b.center[k];
+    m.radius = b.radius;
+
+    // Axis: mean of the unit triangle normals. Every triangle is within
+    // acos(minDot) of it, so a view direction within 90 deg - that angle of
+    // the axis sees only back faces.
+    std::vector<float> &normals = scratch;
+    normals.clear();
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t i = begin; i < end; i += 3)
+    {
+        const MeshVertex &a = mesh.vertices[mesh.indices[i]];
+        const MeshVertex &b = mesh.vertices[mesh.indices[i + 1]];
+        const MeshVertex &c = mesh.vertices[mesh.indices[i + 2]];
+        float e1[3] = {b.px - a.px, b.py - a.py, b.pz - a.pz};
+        float e2[3] = {c.px - a.px, c.py - a.py, c.pz - a.pz};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length <= 0.0f)
+            continue; // degenerate triangles face nowhere
+        for (int k = 0; k < 3; k++)
+        {
+            normals.push_back(n[k] / length);
+            axis[k] += n[k] / length;
+        }
+    }
+    float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    m.coneCutoff = 2.0f;
+    for (int k = 0; k < 3; k++)
+        m.coneAxis[k] = axisLength > 0.0f ? axis[k] / axisLength : 0.0f;
+    if (axisLength <= 0.0f)
+        return;
+    float minDot = 1.0f;
+    for (size_t i = 0; i < normals.size(); i += 3)
+    {
+        float d = normals[i] * m.coneAxis[0] + normals[i + 1] * m.coneAxis[1] + normals[i + 2] * m.coneAxis[2];
+        minDot = d < minDot ? d : minDot;
+    }
+    if (minDot > 0.0f)
+        m.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+// Greedy scan over the triangle order: a meshlet is closed as soon as the
+// next triangle would exceed either limit or starts another material subset
+inline void meshBuildMeshlets(const IndexedMesh &mesh, std::vector<Meshlet> &out,
+                              unsigned maxVertices = MESHLET_MAX_VERTICES, unsigned maxTriangles = MESHLET_MAX_TRIANGLES)
+{
+    out.clear();
+    if (mesh.indices.empty())
+        return;
+    std::vector<uint32_t> stamp(mesh.vertices.size(), UINT32_MAX); // meshlet that last took the vertex
+    std::vector<uint32_t> unique;
+    std::vector<float> scratch;
+    unique.reserve(maxVertices);
+    uint32_t id = 0;
+    size_t begin = 0;
+    const MeshSubset *subset = mesh.levelSubsets(0), *subsetEnd = subset + mesh.subsetsPerLevel();
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        const uint32_t *t = &mesh.indices[i];
+        unsigned added = (stamp[t[0]] != id) + (stamp[t[1]] != id && t[1] != t[0]) +
+                         (stamp[t[2]] != id && t[2] != t[0] && t[2] != t[1]);
+        bool newSubset = false;
+        while (subset != subsetEnd && subset->indexOffset + subset->indexCount <= i)
+        {
+            subset++;
+            newSubset = i != begin;
+        }
+        if (newSubset || unique.size() + added > maxVertices || (i - begin) / 3 + 1 > maxTriangles)
+        {
+            out.push_back(Meshlet());
+            meshFinishMeshlet(mesh, unique, begin, i, scratch, out.back());
+            unique.clear();
+            begin = i;
+            id++;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            if (stamp[t[k]] != id)
+            {
+                stamp[t[k]] = id;
+                unique.push_back(t[k]);
+            }
+        }
+    }
+    out.push_back(Meshlet());
+    meshFinishMeshlet(mesh, unique, begin, mesh.indices.size(), scratch, out.back());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Model-space frustum planes and eye from column-major GL matrices. Pass
+// backfaceCull when GL_CULL_FACE drops GL_BACK faces with CCW front faces.
+inline MeshletView meshMeshletView(const float modelview[16], const float projection[16], bool backfaceCull)
+{
+    MeshletView view;
+    // Rows of projection * modelview (Gribb & Hartmann)
+    float clip[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            clip[r][c] = projection[r] * modelview[c * 4] + projection[4 + r] * modelview[c * 4 + 1] +
+                         projection[8 + r] * modelview[c * 4 + 2] + projection[12 + r] * modelview[c * 4 + 3];
+    for (int p = 0; p < 6; p++)
+    {
+        float sign = (p & 1) ? -1.0f : 1.0f;
+        float *plane = view.planes[p];
+        for (int c = 0; c < 4; c++)
+            plane[c] = clip[3][c] + sign * clip[p / 2][c];
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 1e-12f)
+        {
+            for (int c = 0; c < 4; c++)
+                plane[c] /= length;
+        }
+        else
+        {
+            // Degenerate (e.g. a flattening shadow matrix): accept everything
+            plane[0] = plane[1] = plane[2] = 0.0f;
+            plane[3] = 1.0f;
+        }
+    }
+
+    // Eye from the inverse of the modelview's 3x3 part
+    const float *m = modelview;
+    float inv[9] = {m[5] * m[10] - m[9] * m[6], m[9] * m[2] - m[1] * m[10], m[1] * m[6] - m[5] * m[2],
+                    m[8] * m[6] - m[4] * m[10], m[0] * m[10] - m[8] * m[2], m[4] * m[2] - m[0] * m[6],
+                    m[4] * m[9] - m[8] * m[5], m[8] * m[1] - m[0] * m[9], m[0] * m[5] - m[4] * m[1]};
+    float det = m[0] * inv[0] + m[4] * inv[1] + m[8] * inv[2];
+    view.perspective = projection[11] != 0.0f;
+    // A mirrored or singular modelview flips or loses the winding
+    view.backfaceCull = backfaceCull && det > 1e-12f;
+    for (int k = 0; k < 9; k++)
+        inv[k] = det != 0.0f ? inv[k] / det : 0.0f;
+    // inv is column-major: model = inv * (eye - translation)
+    for (int k = 0; k < 3; k++)
+    {
+        view.eye[k] = -(inv[k] * m[12] + inv[3 + k] * m[13] + inv[6 + k] * m[14]);
+        view.viewDir[k] = -inv[6 + k];
+    }
+    float length = sqrtf(view.viewDir[0] * view.viewDir[0] + view.viewDir[1] * view.viewDir[1] + view.viewDir[2] * view.viewDir[2]);
+    for (int k = 0; k < 3 && length > 0.0f; k++)
+        view.viewDir[k] /= length;
+    return view;
+}
+
+// 0: visible, 1: outside the frustum, 2: back-facing
+inline int meshCullMeshlet(const Meshlet &m, const MeshletView &view)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const float *plane = view.planes[p];
+        if (plane[0] * m.center[0] + plane[1] * m.center[1] + plane[2] * m.center[2] + plane[3] < -m.radius)
+            return 1;
+    }
+    if (!view.backfaceCull || m.coneCutoff > 1.0f)
+        return 0;
+    if (view.perspective)
+    {
+        float d[3] = {m.center[0] - view.eye[0], m.center[1] - view.eye[1], m.center[2] - view.eye[2]};
+        float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        if (d[0] * m.coneAxis[0] + d[1] * m.coneAxis[1] + d[2] * m.coneAxis[2] >= m.coneCutoff * distance + m.radius)
+            return 2;
+    }
+    else if (view.viewDir[0] * m.coneAxis[0] + view.viewDir[1] * m.coneAxis[1] + view.viewDir[2] * m.coneAxis[2] >=
+             m.coneCutoff)
+    {
+        return 2;
+    }
+    return 0;
+}
+
+// Visible meshlets as index ranges, adjacent survivors merged into one range
+inline void meshCullMeshlets(const std::vector<Meshlet> &meshlets, const MeshletView &view,
+                             std::vector<MeshletRange> &visible, MeshletCullStats &stats)
+{
+    visible.clear();
+    stats = MeshletCullStats();
+    stats.meshlets = meshlets.size();
+    for (size_t i = 0; i < meshlets.size(); i++)
+    {
+        const Meshlet &m = meshlets[i];
+        stats.triangles += m.indexCount / 3;
+        int result = meshCullMeshlet(m, view);
+        if (result != 0)
+        {
+            stats.frustumRejected += result == 1;
+            stats.backfaceRejected += result == 2;
+            stats.trianglesRejected += m.indexCount / 3;
+            continue;
+        }
+        if (!visible.empty() && visible.back().indexOffset + visible.back().indexCount == m.indexOffset)
+        {
+            visible.back().indexCount += m.indexCount;
+        }
+        else
+        {
+            MeshletRange range = {m.indexOffset, m.indexCount};
+            visible.push_back(range);
+        }
+    }
+}
@@ -0,0 +1,169 @@
+// mipBench.cpp
+// Mip chain benchmark: gluBuild2DMipmaps against mipBuild() + mipUpload().
+//   mipBench [threads] [size ...]
+// Opens a hidden GLUT window for a context. Each size is a generated size x
+// size RGB image (gradients under noise); the default is 1024, 2048 and
+// 4096. Sizes that are not a power of two show GLU's rescale.
+// Every image goes through GLU, the box filter on 1 and `threads` threads,
+// and the Kaiser filter on `threads` threads, best of three runs each. The
+// GLU and upload times include a glFinish. Power-of-two chains are checked
+// for GLU's level count and sizes.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "glee.h"
+#include "C:\OpenglLib\freeglut\include\GL\freeglut.h"
+#include "mipmaps.h"
+
+using namespace std;
+
+struct BenchImage
+{
+    string name;
+    int width = 0, height = 0, channels = 3;
+    vector<unsigned char> pixels;
+};
+
+static void generate(int size, BenchImage &image)
+{
+    image.name = to_string(size) + "x" + to_string(size);
+    image.width = image.height = size;
+    image.pixels.resize((size_t)size * size * 3);
+    unsigned int seed = 12345;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            int noise = (int)(seed >> 26) - 32;
+            unsigned char *p = &image.pixels[((size_t)y * size + x) * 3];
+            int base[3] = {x * 255 / size, y * 255 / size, (x ^ y) & 255};
+            for (int c = 0; c < 3; c++)
+            {
+                int v = base[c] + noise;
+                p[c] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+        }
+}
+
+static double seconds(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Level sizes of the bound texture as GL sees them
+static vector<pair<int, int>> residentLevels()
+{
+    vector<pair<int, int>> levels;
+    for (int l = 0;; l++)
+    {
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0)
+            break;
+        levels.push_back(make_pair(width, height));
+    }
+    return levels;
+}
+
+int main(int argc, char **argv)
+{
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_RGBA);
+    glutInitWindowSize(64, 64);
+    glutCreateWindow("mipBench");
+    glutHideWindow();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // the images' rows are packed
+
+    int threads = argc > 1 ? atoi(argv[1]) : 0;
+    threads = parallelThreadCount(threads);
+    vector<BenchImage> images;
+    for (int i = 2; i < argc; i++)
+    {
+        int size = atoi(argv[i]);
+        if (size <= 0)
+        {
+            printf("bad size %s\n", argv[i]);
+            continue;
+        }
+        images.push_back(BenchImage());
+        generate(size, images.back());
+    }
+    if (argc <= 2)
+    {
+        int sizes[3] = {1024, 2048, 4096};
+        for (int i = 0; i < 3; i++)
+        {
+            images.push_back(BenchImage());
+            generate(sizes[i], images.back());
+        }
+    }
+
+    const int runs = 3;
+    int failures = 0;
+    printf("GL %s, %s; %d threads\n\n", glGetString(GL_VERSION), glGetString(GL_RENDERER), threads);
+    printf("%-12s %-24s %9s  %9s  %s\n", "image", "builder", "build ms", "total ms", "result");
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const BenchImage &image = images[i];
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        double best = 1e30;
+        vector<pair<int, int>> gluLevels;
+        for (int r = 0; r < runs; r++)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB8, image.width, image.height, GL_RGB,
+                              GL_UNSIGNED_BYTE, image.pixels.data());
+            glFinish();
+            double s = seconds(start);
+            best = s < best ? s : best;
+        }
+        gluLevels = residentLevels();
+        printf("%-12s %-24s %9s  %9.1f  %zu levels\n", image.name.c_str(), "gluBuild2DMipmaps", "-", best * 1000.0,
+               gluLevels.size());
+
+        struct Variant
+        {
+            const char *label;
+            MipFilter filter;
+            int threads;
+        } variants[3] = {{"box", MIP_FILTER_BOX, 1}, {"box", MIP_FILTER_BOX, threads}, {"kaiser", MIP_FILTER_KAISER, threads}};
+        for (int v = 0; v < 3; v++)
+        {
+            MipmapOptions options = mipOptionsForContext(variants[v].filter);
+            options.threads = variants[v].threads;
+            double bestBuild = 1e30, bestTotal = 1e30;
+            bool ok = true;
+            for (int r = 0; r < runs; r++)
+            {
+                MipChain mips;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                ok = mipBuild(image.pixels.data(), image.width, image.height, image.channels, 0, options, mips);
+                double build = seconds(start);
+                mipUpload(mips, GL_RGB8, GL_RGB);
+                glFinish();
+                double total = seconds(start);
+                bestBuild = build < bestBuild ? build : bestBuild;
+                bestTotal = total < bestTotal ? total : bestTotal;
+            }
+            // GLU resizes NPOT images to a power of two even where GL takes
+            // them as they are, so only power-of-two chains can be compared
+            bool powerOfTwo = (image.width & (image.width - 1)) == 0 && (image.height & (image.height - 1)) == 0;
+            ok = ok && (!powerOfTwo || residentLevels() == gluLevels);
+            char label[48];
+            snprintf(label, sizeof(label), "mipBuild %s, %d thread%s", variants[v].label, variants[v].threads,
+                     variants[v].threads == 1 ? "" : "s");
+            printf("%-12s %-24s %9.1f  %9.1f  %s\n", image.name.c_str(), label, bestBuild * 1000.0, bestTotal * 1000.0,
+                   ok ? "ok" : "WRONG LEVELS");
+            failures += !ok;
+        }
+        glDeleteTextures(1, &texture);
+    }
+    printf("\n%s\n", failures == 0 ? "all chains match GLU's levels" : "MISMATCHES");
+    return failures == 0 ? 0 : 2;
+}
@@ -0,0 +1,490 @@
+#pragma once
+// mipmaps.h
+// Mip chain builder used in place of gluBuild2DMipmaps. Levels are filtered
+// in linear light (sRGB decoded, alpha premultiplied) with a box or Kaiser
+// windowed sinc kernel, separably: a vertical pass over whole rows (AVX2 or
+// SSE2 when compiled for it) and a horizontal pass with one vector per
+// pixel. Each level is split into row bands across threads. Any size works;
+// resizing to a power of two only happens when asked for.
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "glee.h"
+#include "parallelFor.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIPMAP_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2 1
+#endif
+
+enum MipFilter
+{
+    MIP_FILTER_BOX,    // area average: the 2x2 mean for even sizes
+    MIP_FILTER_KAISER, // Kaiser windowed sinc, 3 lobes: sharper, less aliasing
+};
+
+struct MipmapOptions
+{
+    MipFilter filter = MIP_FILTER_BOX;
+    bool srgb = true;        // color data: filter in linear light
+    bool wrap = false;       // sample across edges as GL_REPEAT would, rather than clamp
+    bool powerOfTwo = false; // resize the base level to the nearest power of two (no NPOT support)
+    int maxSize = 0;         // clamp the base level to this size (GL_MAX_TEXTURE_SIZE), 0 for none
+    int threads = 0;         // 0: one per core
+};
+
+struct MipLevel
+{
+    int width = 0, height = 0;
+    const unsigned char *external = NULL; // level 0 used as given, without a copy
+    std::vector<unsigned char> storage;
+
+    const unsigned char *pixels() const { return external != NULL ? external : storage.data(); }
+};
+
+// Tightly packed levels, base first, down to 1x1
+struct MipChain
+{
+    int channels = 0;
+    std::vector<MipLevel> levels;
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < levels.size(); i++)
+            total += (size_t)levels[i].width * levels[i].height * channels;
+        return total;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Transfer functions
+
+// 8-bit sRGB to linear
+inline const float *mipSrgbToLinear()
+{
+    static const std::vector<float> table = []() {
+        std::vector<float> t(256);
+        for (int i = 0; i < 256; i++)
+        {
+            double c = i / 255.0;
+            t[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// Linear, quantized to 16 bits, to 8-bit sRGB. 16 bits keep the steps near
+// black (sRGB 1 is linear 0.0003) apart.
+inline const unsigned char *mipLinearToSrgb()
+{
+    static const std::vector<unsigned char> table = []() {
+        std::vector<unsigned char> t(65536);
+        for (int i = 0; i < 65536; i++)
+        {
+            double l = i / 65535.0;
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+            t[i] = (unsigned char)(c * 255.0 + 0.5);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+inline int mipQuantize(float value, float scale)
+{
+    float v = value * scale + 0.5f;
+    return v <= 0.0f ? 0 : v >= scale ? (int)scale : (int)v;
+}
+
+// One row of 8-bit pixels (1, 3 or 4 channels) to linear RGBA floats
+inline void mipDecodeRow(const unsigned char *in, int width, int channels, bool srgb, float *out)
+{
+    // Linear data goes through a table too: a plain scale of the byte
+    static const std::vector<float> unorm = []() {
+        std::vector<float> t(256);
+        for (int i = 0; i < 256; i++)
+            t[i] = i / 255.0f;
+        return t;
+    }();
+    const float *color = srgb ? mipSrgbToLinear() : unorm.data();
+    if (channels == 1)
+    {
+        for (int x = 0; x < width; x++, out += 4)
+        {
+            out[0] = out[1] = out[2] = color[in[x]];
+            out[3] = 1.0f;
+        }
+    }
+    else if (channels == 3)
+    {
+        for (int x = 0; x < width; x++, in += 3, out += 4)
+        {
+            out[0] = color[in[0]];
+            out[1] = color[in[1]];
+            out[2] = color[in[2]];
+            out[3] = 1.0f;
+        }
+    }
+    else
+    {
+        // Premultiplied, so transparent texels do not bleed their color
+        for (int x = 0; x < width; x++, in += 4, out += 4)
+        {
+            float alpha = unorm[in[3]];
+            out[0] = color[in[0]] * alpha;
+            out[1] = color[in[1]] * alpha;
+            out[2] = color[in[2]] * alpha;
+            out[3] = alpha;
+        }
+    }
+}
+
+inline void mipEncodeRow(const float *in, int width, int channels, bool srgb, unsigned char *out)
+{
+    const unsigned char *toSrgb = mipLinearToSrgb();
+    const float scale = srgb ? 65535.0f : 255.0f;
+    const int colors = channels == 1 ? 1 : 3;
+    for (int x = 0; x < width; x++, in += 4, out += channels)
+    {
+        float alpha = in[3];
+        float unpremultiply = channels == 4 && alpha > 0.0f ? 1.0f / alpha : 1.0f;
+        int q[4];
+#if MIPMAP_SSE2
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in), _mm_set1_ps(unpremultiply * scale));
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(scale));
+        _mm_storeu_si128((__m128i *)q, _mm_cvtps_epi32(v));
+#else
+        for (int c = 0; c < 3; c++)
+            q[c] = mipQuantize(in[c] * unpremultiply, scale);
+#endif
+        for (int c = 0; c < colors; c++)
+            out[c] = srgb ? toSrgb[q[c]] : (unsigned char)q[c];
+        if (channels == 4)
+            out[3] = (unsigned char)mipQuantize(alpha, 255.0f);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Filter taps
+
+// Weights of every output sample along one axis, padded with zero weights
+// (on the last real tap's texel) to the same count so the inner loops have a
+// fixed trip count
+struct MipTaps
+{
+    int taps = 0;
+    std::vector<int> index; // output * taps + k: source sample, edges already resolved
+    std::vector<float> weight;
+};
+
+inline double mipBesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32 && term > sum * 1e-12; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// sinc(x) windowed by a Kaiser window of the given radius (alpha 4)
+inline double mipKaiser(double x, double radius)
+{
+    const double alpha = 4.0;
+    double t = x / radius;
+    if (t * t >= 1.0)
+        return 0.0;
+    const double pi = 3.14159265358979323846;
+    double sinc = x == 0.0 ? 1.0 : sin(pi * x) / (pi * x);
+    return sinc * mipBesselI0(alpha * sqrt(1.0 - t * t)) / mipBesselI0(alpha);
+}
+
+inline void mipBuildTaps(int srcSize, int dstSize, MipFilter filter, bool wrap, MipTaps &out)
+{
+    double scale = (double)srcSize / dstSize;
+    double stretch = scale > 1.0 ? scale : 1.0; // widen the kernel when minifying
+    double radius = filter == MIP_FILTER_BOX ? 0.5 * stretch : 3.0 * stretch;
+    std::vector<std::vector<std::pair<int, float>>> samples(dstSize);
+    out.taps = 1;
+    for (int o = 0; o < dstSize; o++)
+    {
+        // Source texel i covers [i, i + 1]
+        double center = (o + 0.5) * scale;
+        int first = (int)floor(center - radius), last = (int)ceil(center + radius);
+        double sum = 0.0;
+        std::vector<std::pair<int, double>> weights;
+        for (int i = first; i < last; i++)
+        {
+            double w;
+            if (filter == MIP_FILTER_BOX)
+            {
+                double lo = fmax(i, center - radius), hi = fmin(i + 1.0, center + radius);
+                w = hi - lo;
+            }
+            else
+                w = mipKaiser((i + 0.5 - center) / stretch, 3.0);
+            if (w == 0.0 || (filter == MIP_FILTER_BOX && w < 0.0))
+                continue;
+            int source = wrap ? ((i % srcSize) + srcSize) % srcSize : i < 0 ? 0 : i >= srcSize ? srcSize - 1 : i;
+            weights.push_back(std::make_pair(source, w));
+            sum += w;
+        }
+        // Merge taps that landed on the same clamped or wrapped texel
+        for (size_t k = 0; k < weights.size(); k++)
+        {
+            bool merged = false;
+            for (size_t m = 0; m < samples[o].size() && !merged; m++)
+                if (samples[o][m].first == weights[k].first)
+                {
+                    samples[o][m].second += (float)(weights[k].second / sum);
+                    merged = true;
+                }
+            if (!merged)
+                samples[o].push_back(std::make_pair(weights[k].first, (float)(weights[k].second / sum)));
+        }
+        if ((int)samples[o].size() > out.taps)
+            out.taps = (int)samples[o].size();
+    }
+    out.index.assign((size_t)dstSize * out.taps, 0);
+    out.weight.assign((size_t)dstSize * out.taps, 0.0f);
+    for (int o = 0; o < dstSize; o++)
+        for (int k = 0; k < out.taps; k++)
+        {
+            bool real = k < (int)samples[o].size();
+            out.index[(size_t)o * out.taps + k] = real ? samples[o][k].first : samples[o].back().first;
+            out.weight[(size_t)o * out.taps + k] = real ? samples[o][k].second : 0.0f;
+        }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Filter kernels
+
+// out[i] = sum over k of weights[k] * rows[k][i]
+inline void mipFilterColumns(const float *const *rows, const float *weights, int taps, float *out, size_t count)
+{
+    size_t i = 0;
+#if MIPMAP_AVX2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(rows[0] + i));
+        for (int k = 1; k < taps; k++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        _mm256_storeu_ps(out + i, sum);
+    }
+#endif
+#if MIPMAP_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + i));
+        for (int k = 1; k < taps; k++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float sum = 0.0f;
+        for (int k = 0; k < taps; k++)
+            sum += weights[k] * rows[k][i];
+        out[i] = sum;
+    }
+}
+
+// One RGBA row filtered horizontally into `width` pixels
+inline void mipFilterRow(const float *in, const MipTaps &h, int width, float *out)
+{
+    const int taps = h.taps;
+    int x = 0;
+#if MIPMAP_AVX2
+    // Two output pixels per register
+    for (; x + 2 <= width; x += 2)
+    {
+        const int *index = &h.index[(size_t)x * taps];
+        const float *weight = &h.weight[(size_t)x * taps];
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < taps; k++)
+        {
+            __m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weight[k])), _mm_set1_ps(weight[taps + k]), 1);
+            __m256 v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(in + index[k] * 4)),
+                                            _mm_loadu_ps(in + index[taps + k] * 4), 1);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(w, v));
+        }
+        _mm256_storeu_ps(out + x * 4, sum);
+    }
+#endif
+    for (; x < width; x++)
+    {
+        const int *index = &h.index[(size_t)x * taps];
+        const float *weight = &h.weight[(size_t)x * taps];
+#if MIPMAP_SSE2
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < taps; k++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(in + index[k] * 4)));
+        _mm_storeu_ps(out + x * 4, sum);
+#else
+        float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < taps; k++)
+            for (int c = 0; c < 4; c++)
+                sum[c] += weight[k] * in[index[k] * 4 + c];
+        memcpy(out + x * 4, sum, sizeof(sum));
+#endif
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Resample an 8-bit image into another size. Each band of output rows
+// decodes the source rows it reads into a few recently used slots, which is
+// all its vertical taps ever need at once.
+inline void mipResample(const unsigned char *src, size_t rowBytes, int srcWidth, int srcHeight, unsigned char *dst,
+                        int dstWidth, int dstHeight, int channels, const MipmapOptions &options)
+{
+    MipTaps vertical, horizontal;
+    mipBuildTaps(srcHeight, dstHeight, options.filter, options.wrap, vertical);
+    mipBuildTaps(srcWidth, dstWidth, options.filter, options.wrap, horizontal);
+    const int taps = vertical.taps;
+    const size_t srcFloats = (size_t)srcWidth * 4;
+
+    // Bands of at least ~64K source texels, so small levels stay on one thread
+    size_t minRows = 65536 / ((size_t)srcWidth * (srcHeight / dstHeight + 1)) + 1;
+    parallelFor((size_t)dstHeight, options.threads, minRows, [&](size_t begin, size_t end) {
+        const int slots = taps + 2;
+        std::vector<float> decoded(slots * srcFloats);
+        std::vector<int> slotRow(slots, -1);
+        std::vector<size_t> slotUse(slots, 0);
+        auto sourceRow = [&](int row, size_t use) -> const float * {
+            int victim = 0;
+            for (int s = 0; s < slots; s++)
+            {
+                if (slotRow[s] == row)
+                {
+                    slotUse[s] = use;
+                    return &decoded[s * srcFloats];
+                }
+                if (slotUse[s] < slotUse[victim])
+                    victim = s;
+            }
+            mipDecodeRow(src + row * rowBytes, srcWidth, channels, options.srgb, &decoded[victim * srcFloats]);
+            slotRow[victim] = row;
+            slotUse[victim] = use;
+            return &decoded[victim * srcFloats];
+        };
+
+        std::vector<float> column(srcFloats), filtered((size_t)dstWidth * 4);
+        std::vector<const float *> rows(taps);
+        for (size_t y = begin; y < end; y++)
+        {
+            for (int k = 0; k < taps; k++)
+                rows[k] = sourceRow(vertical.index[y * taps + k], y + 1);
+            mipFilterColumns(rows.data(), &vertical.weight[y * taps], taps, column.data(), srcFloats);
+            mipFilterRow(column.data(), horizontal, dstWidth, filtered.data());
+            mipEncodeRow(filtered.data(), dstWidth, channels, options.srgb, dst + y * dstWidth * channels);
+        }
+    });
+}
+
+inline int mipNearestPowerOfTwo(int size)
+{
+    int p = 1;
+    while (p * 2 <= size)
+        p *= 2;
+    // p <= size < 2p: round in log space, as GLU does
+    return size * size > p * p * 2 ? p * 2 : p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Build the full chain of an image of 1, 3 or 4 channels (any order: the 4th
+// is taken as alpha) whose rows are `rowBytes` apart (0: packed). The base
+// level keeps pointing at `pixels` when it needs no resize or repacking.
+inline bool mipBuild(const unsigned char *pixels, int width, int height, int channels, size_t rowBytes,
+                     const MipmapOptions &options, MipChain &out)
+{
+    out.levels.clear();
+    out.channels = channels;
+    if (pixels == NULL || width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+        return false;
+    if (rowBytes == 0)
+        rowBytes = (size_t)width * channels;
+
+    int baseWidth = options.powerOfTwo ? mipNearestPowerOfTwo(width) : width;
+    int baseHeight = options.powerOfTwo ? mipNearestPowerOfTwo(height) : height;
+    while (options.maxSize > 0 && (baseWidth > options.maxSize || baseHeight > options.maxSize))
+    {
+        baseWidth = baseWidth > 1 ? baseWidth / 2 : 1;
+        baseHeight = baseHeight > 1 ? baseHeight / 2 : 1;
+    }
+
+    int levelCount = 1;
+    for (int w = baseWidth, h = baseHeight; w > 1 || h > 1; levelCount++)
+    {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    out.levels.resize(levelCount);
+
+    MipLevel &base = out.levels[0];
+    base.width = baseWidth;
+    base.height = baseHeight;
+    if (baseWidth != width || baseHeight != height)
+    {
+        base.storage.resize((size_t)baseWidth * baseHeight * channels);
+        mipResample(pixels, rowBytes, width, height, base.storage.data(), baseWidth, baseHeight, channels, options);
+    }
+    else if (rowBytes != (size_t)width * channels)
+    {
+        base.storage.resize((size_t)width * height * channels);
+        for (int y = 0; y < height; y++)
+            memcpy(&base.storage[(size_t)y * width * channels], pixels + y * rowBytes, (size_t)width * channels);
+    }
+    else
+        base.external = pixels;
+
+    // Each level from the one before: a quarter of the reads of filtering
+    // the base every time, for one extra 8-bit rounding per level
+    for (int l = 1; l < levelCount; l++)
+    {
+        const MipLevel &source = out.levels[l - 1];
+        MipLevel &level = out.levels[l];
+        level.width = source.width > 1 ? source.width / 2 : 1;
+        level.height = source.height > 1 ? source.height / 2 : 1;
+        level.storage.resize((size_t)level.width * level.height * channels);
+        mipResample(source.pixels(), (size_t)source.width * channels, source.width, source.height,
+                    level.storage.data(), level.width, level.height, channels, options);
+    }
+    return true;
+}
+
+// glTexImage2D every level into the bound GL_TEXTURE_2D
+inline void mipUpload(const MipChain &chain, GLint internalFormat, GLenum format)
+{
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t l = 0; l < chain.levels.size(); l++)
+    {
+        const MipLevel &level = chain.levels[l];
+        glTexImage2D(GL_TEXTURE_2D, (GLint)l, internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE,
+                     level.pixels());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+// The options for the current context: sizes GL accepts, threads as given
+inline MipmapOptions mipOptionsForContext(MipFilter filter = MIP_FILTER_BOX, bool srgb = true)
+{
+    MipmapOptions options;
+    options.filter = filter;
+    options.srgb = srgb;
+    options.powerOfTwo = !GLEE_VERSION_2_0 && !GLEE_ARB_texture_non_power_of_two;
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    options.maxSize = maxSize;
+    return options;
+}
@@ -0,0 +1,258 @@
+// objBench.cpp
+// Standalone OBJ face parsing benchmark; needs no window or GL context.
+//   objBench [faces] [threads]
+// Writes two generated OBJ files with the same grid of about `faces`
+// triangles (default 1M), vertex rows interleaved with the faces that use
+// them:
+//  - objBench_plain.obj: every corner as v/vt/vn with absolute indices
+//  - objBench_mixed.obj: corners cycle through v, v/vt, v//vn and v/vt/vn,
+//    every other face with negative (relative) indices
+// Both are loaded with the original ifstream + istringstream + stoi loop the
+// ObjLoader used to have and with objParseFile() on 1 and `threads`
+// threads, best of three runs each. The results are checked against each
+// other and against the indices the generator wrote.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "objParser.h"
+
+using namespace std;
+
+// The line loop of the original loader, storage included
+struct LegacyObj
+{
+    vector<vector<float>> v, vt, vn;
+    vector<vector<int>> f, fvt, fvn;
+};
+
+static bool legacyLoad(const string &filename, LegacyObj &obj, string &error)
+{
+    ifstream file(filename);
+    if (!file.is_open())
+    {
+        error = "cannot open";
+        return false;
+    }
+    string line;
+    try
+    {
+        while (getline(file, line))
+        {
+            if (line.substr(0, 2) == "vt")
+            {
+                float x, y;
+                stringstream ss(line.substr(2));
+                ss >> x;
+                ss >> y;
+                obj.vt.push_back(vector<float>{x, y});
+            }
+            else if (line.substr(0, 2) == "vn")
+            {
+                float x, y, z;
+                stringstream ss(line.substr(2));
+                ss >> x;
+                ss >> y;
+                ss >> z;
+                obj.vn.push_back(vector<float>{x, y, z});
+            }
+            else if (line.substr(0, 2) == "v ")
+            {
+                float x, y, z;
+                istringstream s(line.substr(2));
+                s >> x;
+                s >> y;
+                s >> z;
+                obj.v.push_back(vector<float>{x, y, z});
+            }
+            else if (line.substr(0, 2) == "f ")
+            {
+                vector<int> vIndexSets, vtIndexSets, vnIndexSets;
+                istringstream iss(line);
+                string part;
+                iss >> part; // Skip the initial 'f'
+                while (iss >> part)
+                {
+                    istringstream partStream(part);
+                    string vNumber, vtNumber, vnNumber;
+                    getline(partStream, vNumber, '/');
+                    getline(partStream, vtNumber, '/');
+                    getline(partStream, vnNumber, '/');
+                    vIndexSets.push_back(stoi(vNumber) - 1);
+                    vtIndexSets.push_back(stoi(vtNumber) - 1);
+                    vnIndexSets.push_back(stoi(vnNumber) - 1);
+                }
+                obj.f.push_back(vIndexSets);
+                obj.fvt.push_back(vtIndexSets);
+                obj.fvn.push_back(vnIndexSets);
+            }
+        }
+    }
+    catch (const exception &e)
+    {
+        error = string(e.what()) + " on \"" + line + "\"";
+        return false;
+    }
+    return true;
+}
+
+// Expected corner indices (0-based, -1 when the form omits vt or vn)
+struct Expected
+{
+    vector<int> v, vt, vn;
+};
+
+// Grid of side x side quads, two triangles each. Row j + 1's vertices are
+// written just before row j's faces, so relative indices count back from a
+// different point on every row.
+static bool writeGrid(const string &filename, int side, bool mixed, Expected &expected)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        return false;
+    expected = Expected();
+    int written = 0; // vertices (and vt, vn: one each per vertex) so far
+    auto writeRow = [&](int j) {
+        for (int i = 0; i <= side; i++)
+        {
+            fprintf(file, "v %.4f %.4f %.4f\nvt %.4f %.4f\nvn 0 1 0\n", (float)i, 0.01f * ((i * 7 + j * 3) % 11), (float)j,
+                    (float)i / side, (float)j / side);
+            written++;
+        }
+    };
+    writeRow(0);
+    int corner = 0;
+    for (int j = 0; j < side; j++)
+    {
+        writeRow(j + 1);
+        fprintf(file, "g row%d\n", j);
+        for (int i = 0; i < side; i++)
+        {
+            int a = j * (side + 1) + i, b = a + 1, c = a + side + 2, d = a + side + 1;
+            int triangles[2][3] = {{a, b, c}, {a, c, d}};
+            for (int t = 0; t < 2; t++)
+            {
+                bool relative = mixed && (i + t) % 2 == 1;
+                fputc('f', file);
+                for (int k = 0; k < 3; k++, corner++)
+                {
+                    int index = triangles[t][k];
+                    int form = mixed ? corner % 4 : 3; // v, v/vt, v//vn, v/vt/vn
+                    int n = relative ? index - written : index + 1;
+                    if (form == 0)
+                        fprintf(file, " %d", n);
+                    else if (form == 1)
+                        fprintf(file, " %d/%d", n, n);
+                    else if (form == 2)
+                        fprintf(file, " %d//%d", n, n);
+                    else
+                        fprintf(file, " %d/%d/%d", n, n, n);
+                    expected.v.push_back(index);
+                    expected.vt.push_back(form == 1 || form == 3 ? index : -1);
+                    expected.vn.push_back(form >= 2 ? index : -1);
+                }
+                fputc('\n', file);
+            }
+        }
+    }
+    return fclose(file) == 0;
+}
+
+static bool matches(const ObjMeshData &mesh, const Expected &expected)
+{
+    return mesh.cornerV == expected.v && mesh.cornerVT == expected.vt && mesh.cornerVN == expected.vn &&
+           mesh.faceCount() * 3 == expected.v.size();
+}
+
+static bool matches(const LegacyObj &obj, const Expected &expected)
+{
+    if (obj.f.size() * 3 != expected.v.size())
+        return false;
+    for (size_t f = 0; f < obj.f.size(); f++)
+        for (int k = 0; k < 3; k++)
+            if (obj.f[f][k] != expected.v[f * 3 + k] || obj.fvt[f][k] != expected.vt[f * 3 + k] ||
+                obj.fvn[f][k] != expected.vn[f * 3 + k])
+                return false;
+    return true;
+}
+
+static double fileMegabytes(const string &filename)
+{
+    MappedFile file(filename);
+    return file.size() / (1024.0 * 1024.0);
+}
+
+int main(int argc, char **argv)
+{
+    long faces = argc > 1 ? atol(argv[1]) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : (int)thread::hardware_concurrency();
+    int side = (int)ceil(sqrt(faces / 2.0));
+    const int runs = 3;
+    int failures = 0;
+    printf("%d x %d grid, %ld triangles, %d threads\n\n", side, side, 2L * side * side, threads);
+    printf("%-6s %-22s %8s  %9s  %7s  %s\n", "file", "parser", "MB/s", "Mfaces/s", "ms", "result");
+
+    for (int mixed = 0; mixed < 2; mixed++)
+    {
+        string filename = mixed ? "objBench_mixed.obj" : "objBench_plain.obj";
+        Expected expected;
+        if (!writeGrid(filename, side, mixed != 0, expected))
+        {
+            printf("could not write %s\n", filename.c_str());
+            return 1;
+        }
+        double megabytes = fileMegabytes(filename);
+        double faceCount = expected.v.size() / 3.0;
+        const char *name = mixed ? "mixed" : "plain";
+
+        double best = 1e30;
+        string error;
+        bool legacyOk = true, legacyMatches = true;
+        for (int r = 0; r < runs && legacyOk; r++)
+        {
+            LegacyObj obj;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            legacyOk = legacyLoad(filename, obj, error);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            best = seconds < best ? seconds : best;
+            legacyMatches = legacyOk && matches(obj, expected);
+        }
+        if (legacyOk)
+            printf("%-6s %-22s %8.1f  %9.2f  %7.1f  %s\n", name, "istringstream + stoi", megabytes / best,
+                   faceCount / best / 1e6, best * 1000.0, legacyMatches ? "ok" : "WRONG");
+        else
+            printf("%-6s %-22s %8s  %9s  %7s  load aborted: %s\n", name, "istringstream + stoi", "-", "-", "-",
+                   error.c_str());
+        // The old loop only has to handle the plain file
+        failures += !mixed && !legacyMatches;
+
+        int threadCounts[2] = {1, threads};
+        for (int t = 0; t < 2; t++)
+        {
+            best = 1e30;
+            bool ok = true;
+            int used = 1;
+            for (int r = 0; r < runs; r++)
+            {
+                ObjMeshData mesh;
+                ObjParseStats stats;
+                ok = objParseFile(filename, mesh, &stats, threadCounts[t]) && matches(mesh, expected);
+                best = stats.seconds < best ? stats.seconds : best;
+                used = stats.threads;
+            }
+            char label[32];
+            snprintf(label, sizeof(label), "objParseFile, %d thread%s", used, used == 1 ? "" : "s");
+            printf("%-6s %-22s %8.1f  %9.2f  %7.1f  %s\n", name, label, megabytes / best, faceCount / best / 1e6,
+                   best * 1000.0, ok ? "ok" : "WRONG");
+            failures += !ok;
+        }
+        remove(filename.c_str());
+    }
+    printf("\n%s\n", failures == 0 ? "all results match the generator" : "MISMATCHES");
+    return failures == 0 ? 0 : 2;
+}
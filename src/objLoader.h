@@ -1,15 +1,48 @@
 #pragma once
 #include <iostream>
 #include <vector>
-#include <fstream>
 #include <string>
-#include <sstream>
+#include <cstddef>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "glee.h"
 #include "C:\OpenglLib\freeglut\include\GL\freeglut.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "objParser.h"
+#include "objMaterials.h"
+#include "meshWeld.h"
+#include "meshTriangulate.h"
+#include "meshNormals.h"
+#include "meshOptimize.h"
+#include "meshSimplify.h"
+#include "meshBounds.h"
+#include "meshQuantize.h"
+#include "meshProgram.h"
+#include "meshlets.h"
+#include "meshEdges.h"
+#include "meshCache.h"
+#include "textureCache.h"
+#include "mipmaps.h"
+#include "hotReload.h"
 
 using namespace std;
 
+// Load-time processing switches for ObjLoader
+struct ObjLoadOptions
+{
+    bool optimizeVertexCache = true;    // Forsyth triangle order + vertex fetch order
+    bool useMeshCache = true;   // read/write "<obj>.cooked" next to the OBJ
+    int lodLevels = 6;  // quadric-simplified LOD chain incl. the full mesh; 1 disables it
+    float lodFullDetailPixels = 400.0f; // projected bounding sphere diameter that still gets LOD 0
+    bool async = false; // parse and decode on a worker thread; draw() skips the mesh until ready
+    bool quantizeVertices = false;  // 16-byte QuantizedVertex VBO and cooked file (needs GL 2.0 to draw)
+    bool buildMeshlets = false; // split LOD 0 into meshlets culled on the CPU each draw (dense meshes)
+    bool hotReload = false; // watch the OBJ, its .mtl files and textures; rebuild on change and patch the buffers
+};
+
 class ObjLoader
 {
 public:
@@ -20,111 +53,42 @@ public:
         float z;
     };
     int vi=0, vti=0, vni=0;
-    GLuint textures[1];
+    GLuint textures[1] = { 0 };
     cv::Mat grassImg;
     std::string texturePath;
-    ObjLoader(string filename, string texturePath) {
-        ifstream file(filename);
-        if (!file.is_open()) {
-            printf("Error opening file!\n");
-        }
-        string line;
-        while (getline(file, line))
-        {
-            if(line.substr(0, 2) == "vt"){
-                float x, y;
-                stringstream ss(line.substr(2));
-                ss >> x; ss >> y;
-                vector<GLfloat> Point;
-                Point.push_back(x);
-                Point.push_back(y);
-                vt.push_back(Point);
-            }
-            else if(line.substr(0, 2) == "vn"){
-                float x, y, z;
-                stringstream ss(line.substr(2));
-                ss >> x; ss >> y; ss >> z;
-                vector<GLfloat> Point;
-                Point.push_back(x);
-                Point.push_back(y);
-                Point.push_back(z);
-                vn.push_back(Point);
-            }
-            else if (line.substr(0, 2) == "v ")
-            {
-                // vi++;
-                vector<GLfloat> Point;
-                GLfloat x, y, z;
-                istringstream s(line.substr(2));
-                s >> x; s >> y; s >> z;
-                Point.push_back(x);
-                Point.push_back(y);
-                Point.push_back(z);
-                v.push_back(Point);
-
-                if (x > maxX) {
-                    maxX = x;
-                }else if (x < minX) {
-                    minX = x;
-                }
-
-                if (y > maxY) {
-                    maxY = y;
-                }else if (y < minY) {
-                    minY = y;
-                }
-
-                if (z > maxZ) {
-                    maxZ = z;
-                }else if (z < minZ) {
-                    minZ = z;
-                }
-            }
-            else if (line.substr(0, 2) == "f ")
-            {
-                vector<GLint> vIndexSets;
-                vector<GLint> vtIndexSets;
-                vector<GLint> vnIndexSets;
-
-                std::istringstream iss(line);
-                std::string part;
-                iss >> part; // Skip the initial 'f'
-
-                while (iss >> part) {
-                    std::istringstream partStream(part);
-                    std::string vNumber, vtNumber, vnNumber;
-                    std::getline(partStream, vNumber, '/');
-                    std::getline(partStream, vtNumber, '/');
-                    std::getline(partStream, vnNumber, '/');
-                    vIndexSets.push_back(std::stoi(vNumber) - 1);
-                    vtIndexSets.push_back(std::stoi(vtNumber) - 1);
-                    vnIndexSets.push_back(std::stoi(vnNumber) - 1);
-                }
-                f.push_back(vIndexSets);
-                fvt.push_back(vtIndexSets);
-                fvn.push_back(vnIndexSets);
-            }
-            // else: ignore
-        }
-        file.close();
+    ObjLoader(string filename, string texturePath, const ObjLoadOptions& options = ObjLoadOptions()) {
         srand(time(NULL));
-
-        grassImg = cv::imread(texturePath); 
-        if (grassImg.empty()) {
-           std::cout << "grassImg empty\n";
+        this->texturePath = texturePath;
+        sourcePath = filename;
+        loadOptions = options;
+        lodFullDetailPixels = options.lodFullDetailPixels;
+        if (options.async) {
+            loadThread = thread([this, filename, texturePath, options]() { load(filename, texturePath, options); });
         }
         else {
-            cv::flip(grassImg, grassImg, 0);
-            glGenTextures(1, &textures[0]);
-            glBindTexture(GL_TEXTURE_2D, textures[0]);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            load(filename, texturePath, options);
+        }
+    }
+    ~ObjLoader() {
+        watcher.stop();
+        if (reloadThread.joinable()) {
+            reloadThread.join();
+        }
+        if (loadThread.joinable()) {
+            loadThread.join();
+        }
+    }
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, grassImg.cols, grassImg.rows, 0, GL_BGR_EXT, GL_UNSIGNED_BYTE, grassImg.ptr());
+    // True once the CPU-side mesh and image are complete. Until then draw()
+    // and init() do nothing; GL uploads happen on the first draw after this.
+    bool isReady() {
+        if (!loaded.load(memory_order_acquire)) {
+            return false;
         }
+        if (loadThread.joinable()) {
+            loadThread.join();
+        }
+        return true;
     }
 
     void setTexture(std::string filename) {
@@ -202,21 +166,67 @@ public:
             break;
         }
     }
+    // Bind the mesh texture. Uploads it the first time, afterwards this is bind-only.
+    // A mesh with materials binds per subset instead (bindSubsetTexture).
     void init() {
-        if (grassImg.empty()) {
+        if (!isReady()) {
+            return;
+        }
+        updateReload();
+        if (!textureResident) {
+            uploadTexture();
+        }
+        boundTexture = ~(GLuint)0; // nothing bound by this pass yet
+        textureBinds = 0;
+        if (indexed.subsets.empty()) {
+            bindTexture(textures[0]);
+        }
+    }
+
+    // Take the textures from the shared cache, uploading the decoded images
+    // with a full mip chain if no other user has them yet, and drop the CPU
+    // copies. Each material's map_Kd is acquired once here, not per draw.
+    void uploadTexture() {
+        textureResident = true;
+        if (!textureHashed) {
             std::cout << "grassImg empty\n";
         }
         else {
-            glBindTexture(GL_TEXTURE_2D, textures[0]);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            textures[0] = acquireImage(texturePath, textureHash, grassImg, GL_CLAMP);
+            grassImg.release();
+        }
+        for (size_t m = 0; m < materialSlots.size(); m++) {
+            MaterialSlot& slot = materialSlots[m];
+            if (slot.textureHashed) {
+                slot.texture = acquireImage(slot.texturePath, slot.textureHash, slot.image, GL_REPEAT);
+                slot.image.release();
+            }
+        }
+    }
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, grassImg.cols, grassImg.rows, 0, GL_BGR_EXT, GL_UNSIGNED_BYTE, grassImg.ptr());
+    void releaseTexture() {
+        textureCache().release(textures[0]);
+        textures[0] = 0;
+        for (size_t m = 0; m < materialSlots.size(); m++) {
+            textureCache().release(materialSlots[m].texture);
+            materialSlots[m].texture = 0;
         }
+        textureResident = false;
     }
+
+    // glBindTexture calls since the last init(): at most one per material
+    // per pass, however many triangles use it
+    unsigned lastTextureBinds() const {
+        return textureBinds;
+    }
+
+    // Number of texture image uploads done by all loaders; stays constant
+    // across steady-state frames.
+    static unsigned long& textureUploadCount() {
+        static unsigned long count = 0;
+        return count;
+    }
+
     void resetPos() {
         rotateAngleX = 0, rotateAngleY = 0, rotateAngleZ = 0;
         posX = 0, posY = 0, posZ = 0;
@@ -228,6 +238,16 @@ public:
         cameraLookAt[2] = 0.0;
     }
     void draw(int shadowMode) {
+        if (!prepare()) {
+            return;
+        }
+        if (shadeMode == 1 && flatVertices.empty()) {
+            setShadeMode(1);
+        }
+        currentLod = forcedLod >= 0 ? forcedLod : selectLod();
+        if (currentLod >= (int)indexed.lods.size()) {
+            currentLod = indexed.lods.empty() ? 0 : (int)indexed.lods.size() - 1;
+        }
         switch (renderMode) {
             case 0:
                 drawModePoint();
@@ -241,10 +261,203 @@ public:
         }
     }
 
+    // Upload the welded mesh into a vertex and an index buffer object.
+    // Called on the first draw, once a GL context exists.
+    void uploadBuffers() {
+        buffersResident = true;
+        if (!GLEE_VERSION_1_5 || indexed.vertexCount() == 0) {
+            return; // draw straight from the client-side arrays
+        }
+        // Quantized vertices need the decoding shader; without it upload floats
+        quantizedResident = !quantized.empty() && meshProgramCreate(program, MESH_PROGRAM_QUANTIZED, "ObjLoader");
+        glGenBuffers(1, &vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        if (quantizedResident) {
+            glBufferData(GL_ARRAY_BUFFER, quantized.vertices.size() * sizeof(QuantizedVertex), quantized.vertices.data(), GL_STATIC_DRAW);
+            printf("ObjLoader: quantized vertex buffer %.2f MB (%.2f MB as floats)\n",
+                quantized.vertices.size() * sizeof(QuantizedVertex) / (1024.0 * 1024.0),
+                indexed.vertices.size() * sizeof(MeshVertex) / (1024.0 * 1024.0));
+        }
+        else {
+            glBufferData(GL_ARRAY_BUFFER, indexed.vertices.size() * sizeof(MeshVertex), indexed.vertices.data(), GL_STATIC_DRAW);
+        }
+        // Every LOD lives in the one index buffer: full mesh first, then the chain
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexed.drawIndexCount() * sizeof(uint32_t), NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexed.indices.size() * sizeof(uint32_t), indexed.indices.data());
+        if (!indexed.lodIndices.empty()) {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexed.indices.size() * sizeof(uint32_t),
+                indexed.lodIndices.size() * sizeof(uint32_t), indexed.lodIndices.data());
+        }
+        if (!edges.indices.empty()) {
+            glGenBuffers(1, &edgeBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, edgeBuffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, edges.indices.size() * sizeof(uint32_t), edges.indices.data(), GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        uploadFlatBuffer();
+    }
+    void uploadFlatBuffer() {
+        if (vertexBuffer == 0 || flatVertexBuffer != 0 || flatVertices.empty()) {
+            return;
+        }
+        glGenBuffers(1, &flatVertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, flatVertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, flatVertices.size() * sizeof(MeshVertex), flatVertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void releaseBuffers() {
+        if (vertexBuffer != 0) {
+            glDeleteBuffers(1, &vertexBuffer);
+            glDeleteBuffers(1, &indexBuffer);
+        }
+        if (edgeBuffer != 0) {
+            glDeleteBuffers(1, &edgeBuffer);
+        }
+        if (flatVertexBuffer != 0) {
+            glDeleteBuffers(1, &flatVertexBuffer);
+        }
+        meshProgramDelete(program);
+        vertexBuffer = indexBuffer = edgeBuffer = flatVertexBuffer = 0;
+        buffersResident = false;
+        quantizedResident = false;
+    }
+
+    // The flat stream is not built while a reload is rebuilding, since
+    // rebuild() diffs against it; draw() keeps to the smooth stream and
+    // builds it once applyReload() has run.
+    void setShadeMode(int mode) {
+        shadeMode = mode;
+        if (mode == 1 && flatVertices.empty() && isReady() && reloadStage.load(memory_order_relaxed) == 0) {
+            meshBuildFlatVertices(indexed, faceNormals, flatVertices);
+            if (buffersResident) {
+                uploadFlatBuffer();
+            }
+        }
+    }
+
     void setRenderMode(int mode) {
         renderMode = mode;
     }
 
+    // -1 picks the LOD from the projected size each draw, otherwise a fixed level
+    void setLod(int level) {
+        forcedLod = level;
+    }
+    int lodCount() const {
+        return indexed.lods.empty() ? 1 : (int)indexed.lods.size();
+    }
+    // Level used by the most recent draw()
+    int lastLod() const {
+        return currentLod;
+    }
+    // LOD 0 at lodFullDetailPixels and above, one level coarser each time the
+    // projected bounding sphere diameter halves
+    int lodForPixels(float pixels) const {
+        int level = 0;
+        for (float limit = lodFullDetailPixels; pixels < limit && level + 1 < lodCount(); limit *= 0.5f) {
+            level++;
+        }
+        return level;
+    }
+
+    // For draw paths outside the class (GrassField): make the mesh
+    // drawable, bind its arrays, and address the index range of a LOD.
+    bool prepare() {
+        if (!isReady()) {
+            return false;
+        }
+        if (!buffersResident) {
+            uploadBuffers();
+        }
+        updateReload();
+        return true;
+    }
+    void bindMeshArrays() {
+        bindVertexArrays(true, true);
+    }
+    void unbindMeshArrays() {
+        unbindVertexArrays();
+    }
+    // Draw ranges of a LOD: one per material subset, or a single range for
+    // the whole level when the OBJ has no usemtl. Subsets may be empty.
+    int subsetCount() const {
+        return indexed.subsets.empty() ? 1 : (int)indexed.subsetsPerLevel();
+    }
+    GLsizei subsetIndexCount(int lod, int subset) const {
+        return indexed.subsets.empty() ? lodIndexCount(lod) : (GLsizei)indexed.levelSubsets(lod)[subset].indexCount;
+    }
+    const GLvoid* subsetIndexPointer(int lod, int subset) const {
+        return indexed.subsets.empty() ? lodIndexPointer(lod) : indexPointer(indexed.levelSubsets(lod)[subset].indexOffset);
+    }
+    // The same ranges in system memory, and the float vertices they index
+    // (kept even when the buffer holds quantized ones), for draw paths that
+    // transform vertices on the CPU
+    const uint32_t* subsetIndexData(int lod, int subset) const {
+        size_t offset = indexed.subsets.empty() ? (indexed.lods.empty() ? 0 : indexed.lods[lod].indexOffset)
+            : indexed.levelSubsets(lod)[subset].indexOffset;
+        if (offset < indexed.indices.size()) {
+            return indexed.indices.data() + offset;
+        }
+        return indexed.lodIndices.data() + (offset - indexed.indices.size());
+    }
+    const vector<MeshVertex>& vertexData() const {
+        return indexed.vertices;
+    }
+    // Bind the texture of a subset's material (the loader's own texture for
+    // materials without map_Kd) unless this pass has it bound already
+    void bindSubsetTexture(int lod, int subset) {
+        bindTexture(materialTexture(subsetMaterial(lod, subset)));
+    }
+    GLsizei lodIndexCount(int lod) const {
+        return indexed.lods.empty() ? (GLsizei)indexed.indices.size() : (GLsizei)indexed.lods[lod].indexCount;
+    }
+    // Buffer offset when the IBO is bound, otherwise a client pointer
+    const GLvoid* lodIndexPointer(int lod) const {
+        return indexPointer(indexed.lods.empty() ? 0 : indexed.lods[lod].indexOffset);
+    }
+    const GLvoid* indexPointer(size_t offset) const {
+        if (vertexBuffer != 0) {
+            return (const GLvoid*)(offset * sizeof(uint32_t));
+        }
+        if (offset < indexed.indices.size()) {
+            return (const GLvoid*)(indexed.indices.data() + offset);
+        }
+        return (const GLvoid*)(indexed.lodIndices.data() + (offset - indexed.indices.size()));
+    }
+    // The rotate() + translate() placement as a matrix
+    void localMatrix(GLfloat m[16]) {
+        glPushMatrix();
+        glLoadIdentity();
+        rotate();
+        translate();
+        glGetFloatv(GL_MODELVIEW_MATRIX, m);
+        glPopMatrix();
+    }
+    // True when the vertex buffer holds QuantizedVertex: positions and UVs
+    // need quantization() applied and the normal is octahedral
+    bool quantizedDraw() const {
+        return quantizedResident;
+    }
+    const QuantizationParams& quantization() const {
+        return quantized.params;
+    }
+    // Lit, textured shading for the mesh arrays: the decoding shader for a
+    // quantized buffer, otherwise the fixed-function state as set
+    void beginShading(int shadowMode) {
+        if (quantizedResident) {
+            meshProgramBegin(program, shadowMode, &quantized.params);
+        }
+    }
+    void endShading() {
+        if (quantizedResident) {
+            meshProgramEnd();
+        }
+    }
+
     void setColorMode(int mode) {
         colorMode = mode;
         if (mode != 0) {
@@ -266,16 +479,97 @@ public:
         cameraLookAt[index]+=count;
     }
 
+    size_t meshletCount() const {
+        return meshlets.size();
+    }
+    // Culling result of the most recent draw of LOD 0 with meshlets
+    const MeshletCullStats& meshletStats() const {
+        return cullStats;
+    }
+
+    // Exact AABB and bounding sphere in model space (valid once isReady())
+    const MeshBounds& bounds() const {
+        return meshBounds;
+    }
+    // Welded vertices and full-detail triangles (valid once isReady())
+    size_t vertexCount() const {
+        return indexed.vertexCount();
+    }
+    size_t triangleCount() const {
+        return indexed.triangleCount();
+    }
+
+    // Bytes held by the CPU-side mesh
+    size_t memoryFootprint() const {
+        return sizeof(*this) + mesh.memoryFootprint() + indexed.memoryFootprint() +
+            faceNormals.capacity() * sizeof(float) + flatVertices.capacity() * sizeof(MeshVertex) +
+            quantized.vertices.capacity() * sizeof(QuantizedVertex) + meshlets.capacity() * sizeof(Meshlet) +
+            materialSlots.capacity() * sizeof(MaterialSlot) + edges.memoryFootprint();
+    }
+
 private:
-    vector<vector<GLfloat>> v;
-    vector<vector<GLint>> f;
-    vector<vector<GLfloat>> vt;
-    vector<vector<GLint>> fvt;
-    vector<vector<GLfloat>> vn;
-    vector<vector<GLint>> fvn; 
-    float maxX=0, maxY=0, maxZ=0;
+    // What drawing needs of one usemtl material; parallel to indexed.materials
+    struct MaterialSlot {
+        GLfloat diffuse[3] = { 1.0f, 1.0f, 1.0f };
+        bool hasDiffuse = false;    // Kd given, otherwise defaultColorFace
+        std::string texturePath;    // resolved map_Kd
+        bool textureHashed = false;
+        uint64_t textureHash = 0;
+        cv::Mat image;  // decoded on the load thread until uploaded
+        GLuint texture = 0; // from textureCache(); 0: use textures[0]
+    };
+
+    // A finished rebuild waiting for the GL thread
+    struct PendingReload {
+        unique_ptr<ObjLoader> loader;
+        BufferDelta vertices, indices, edges, flat;
+        double buildMs = 0.0;
+        chrono::steady_clock::time_point changedAt;
+    };
+
+    thread loadThread;
+    atomic<bool> loaded{ false };
+    string sourcePath;
+    ObjLoadOptions loadOptions;
+    FileWatcher watcher;    // running when ObjLoadOptions::hotReload
+    mutex reloadMutex;      // guards reloadRequested and reloadChangedAt
+    bool reloadRequested = false;
+    chrono::steady_clock::time_point reloadChangedAt;   // first write of the queued change
+    atomic<int> reloadStage{ 0 };   // 0: idle, 1: reloadThread rebuilding, 2: pendingReload ready
+    thread reloadThread;
+    PendingReload pendingReload;
+    ObjMeshData mesh;   // flat v/vt/vn arrays and f/fvt/fvn corner indices
+    IndexedMesh indexed;    // welded (v, vt, vn) vertices + triangle indices
+    GLuint vertexBuffer = 0, indexBuffer = 0;   // 0 when drawing from client memory
+    bool buffersResident = false;
+    QuantizedMesh quantized;    // empty unless ObjLoadOptions::quantizeVertices
+    bool quantizedResident = false; // vertexBuffer holds `quantized`
+    MeshProgram program;    // decodes quantized vertices
+    bool textureResident = false;
+    bool textureHashed = false;     // textureHash is valid (the file could be read)
+    uint64_t textureHash = 0;       // TextureCache key with texturePath
+    vector<MaterialSlot> materialSlots;
+    GLuint boundTexture = 0;    // last texture bound by this pass, see init()
+    unsigned textureBinds = 0;
+    vector<GLfloat> faceNormals;    // one unit normal per triangle
+    vector<MeshVertex> flatVertices;    // unshared stream for flat shading, all LODs, built on demand
+    GLuint flatVertexBuffer = 0;
+    MeshEdges edges;    // unique edges of every level, for wireframe
+    GLuint edgeBuffer = 0;
+    MeshBounds meshBounds;  // exact box + bounding sphere of the positions
+    vector<Meshlet> meshlets;   // runs of LOD 0 triangles, empty unless ObjLoadOptions::buildMeshlets
+    vector<MeshletRange> visibleRanges; // scratch for the per-draw culling pass
+    vector<GLsizei> rangeCounts;
+    vector<GLint> rangeFirsts;
+    vector<const GLvoid*> rangePointers;
+    MeshletCullStats cullStats;
+    float maxX=0, maxY=0, maxZ=0;   // copies of meshBounds for the drawing helpers
     float minX=0, minY=0, minZ=0;
     int renderMode = 2;     //0: point, 1: line, 2: face
+    int shadeMode = 0;      //0: smooth (vertex normals), 1: flat (face normals)
+    int forcedLod = -1;     //-1: by projected size
+    int currentLod = 0;
+    float lodFullDetailPixels = 400.0f;
     int rotateAngleX = -90, rotateAngleY = 0, rotateAngleZ = 0;
     float posX = -1.0, posY = 0.0, posZ = -0.03;
     int colorMode = 0;      //0: default, 1: random
@@ -286,6 +580,444 @@ private:
     double cameraAt[3] = { 1.0, 1.0, 10.0 }, 
         cameraLookAt[3] = { 0.0, 0.0, 0.0 };
 
+    // Everything that needs no GL context: mesh (cooked cache or OBJ text) and
+    // texture decode. Runs on loadThread for async loaders.
+    void load(const string& filename, const string& texturePath, const ObjLoadOptions& options) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        uint32_t cookFlags = meshCookFlags(options.optimizeVertexCache, options.lodLevels, options.quantizeVertices);
+        string cachePath = filename + ".cooked";
+        if (options.useMeshCache && meshLoadCooked(cachePath, filename, cookFlags, indexed, meshBounds, &quantized)) {
+            printf("ObjLoader: %s from cooked cache\n", cachePath.c_str());
+            if (options.quantizeVertices) {
+                printQuantization();
+            }
+        }
+        else {
+            loadObj(filename, options);
+            if (options.quantizeVertices) {
+                meshQuantize(indexed, meshBounds, quantized);
+                printQuantization();
+            }
+            if (options.useMeshCache && indexed.vertexCount() != 0) {
+                if (!meshSaveCooked(cachePath, filename, indexed, cookFlags, meshBounds, &quantized)) {
+                    printf("ObjLoader: could not write %s\n", cachePath.c_str());
+                }
+            }
+        }
+        if (!meshBounds.empty()) {
+            minX = meshBounds.min[0], minY = meshBounds.min[1], minZ = meshBounds.min[2];
+            maxX = meshBounds.max[0], maxY = meshBounds.max[1], maxZ = meshBounds.max[2];
+        }
+        meshComputeFaceNormals(indexed, faceNormals);
+        meshBuildEdges(indexed, edges);
+        printf("ObjLoader: %zu unique edges for wireframe (%zu triangle sides)\n",
+            edges.lineCount(0), indexed.indices.size());
+        if (options.buildMeshlets) {
+            meshBuildMeshlets(indexed, meshlets);
+            printf("ObjLoader: %zu meshlets, %.1f triangles each\n", meshlets.size(),
+                meshlets.empty() ? 0.0 : indexed.triangleCount() / (double)meshlets.size());
+        }
+        printf("ObjLoader: %zu vertices / %zu triangles ready in %.2f ms, %.2f MB resident\n",
+            indexed.vertexCount(), indexed.triangleCount(),
+            chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(),
+            memoryFootprint() / (1024.0 * 1024.0));
+
+        // Decode now, upload once a GL context exists (see uploadTexture).
+        // Nothing to decode if another loader already has it resident.
+        textureHashed = TextureCache::hashFile(texturePath, textureHash);
+        if (!textureHashed || !textureCache().contains(texturePath, textureHash)) {
+            decodeTexture();
+        }
+        loadMaterials(filename);
+        if (options.hotReload) {
+            startWatching();
+        }
+        loaded.store(true, memory_order_release);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Hot reload. The watcher thread only flags a change; the GL thread starts
+    // a rebuild on reloadThread (a complete ObjLoader, plus the diff of its
+    // arrays against the resident ones), and once that is done patches the
+    // buffers with the changed ranges and takes over the new CPU state. At
+    // most one rebuild runs at a time; a change during one queues the next.
+
+    typedef vector<pair<const void*, size_t>> BufferParts;
+
+    // The OBJ, its material libraries and every texture, as found by this load
+    void startWatching() {
+        vector<string> paths(1, sourcePath);
+        paths.push_back(texturePath);
+        for (size_t i = 0; i < indexed.materialLibraries.size(); i++) {
+            paths.push_back(objResolvePath(sourcePath, indexed.materialLibraries[i]));
+        }
+        for (size_t m = 0; m < materialSlots.size(); m++) {
+            paths.push_back(materialSlots[m].texturePath);
+        }
+        bool watching = watcher.start(paths, [this](chrono::steady_clock::time_point changed) {
+            lock_guard<mutex> lock(reloadMutex);
+            if (!reloadRequested) {
+                reloadChangedAt = changed;
+            }
+            reloadRequested = true;
+        });
+        printf("ObjLoader: %s %s for hot reload\n", watching ? "watching" : "could not watch", sourcePath.c_str());
+    }
+
+    // GL thread, every prepare()/init(): take over a finished rebuild, then
+    // start the next one if a file changed meanwhile
+    void updateReload() {
+        if (reloadStage.load(memory_order_acquire) == 2) {
+            reloadThread.join();
+            applyReload();
+            reloadStage.store(0, memory_order_relaxed);
+        }
+        if (reloadStage.load(memory_order_relaxed) != 0) {
+            return;
+        }
+        lock_guard<mutex> lock(reloadMutex);
+        if (!reloadRequested) {
+            return;
+        }
+        reloadRequested = false;
+        pendingReload = PendingReload();
+        pendingReload.changedAt = reloadChangedAt;
+        // What the rebuild diffs against, fixed while it runs
+        bool quantizedStream = quantizedResident;
+        bool flat = !flatVertices.empty();
+        reloadStage.store(1, memory_order_relaxed);
+        reloadThread = thread([this, quantizedStream, flat]() { rebuild(quantizedStream, flat); });
+    }
+
+    // reloadThread: the full load path on the changed files, then the diff.
+    // Only reads this loader's mesh arrays, which the GL thread leaves alone
+    // until reloadStage says the rebuild is done (setShadeMode() holds back
+    // the flat stream meanwhile).
+    void rebuild(bool quantizedStream, bool flat) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        ObjLoadOptions options = loadOptions;
+        options.async = false;
+        options.hotReload = false;
+        pendingReload.loader.reset(new ObjLoader(sourcePath, texturePath, options));
+        ObjLoader& next = *pendingReload.loader;
+        if (next.indexed.triangleCount() != 0) {
+            if (flat) {
+                meshBuildFlatVertices(next.indexed, next.faceNormals, next.flatVertices);
+            }
+            pendingReload.vertices = meshDiffBuffer(vertexParts(quantizedStream), next.vertexParts(quantizedStream));
+            pendingReload.indices = meshDiffBuffer(indexParts(), next.indexParts());
+            pendingReload.edges = meshDiffBuffer(edgeParts(), next.edgeParts());
+            pendingReload.flat = meshDiffBuffer(flatParts(), next.flatParts());
+        }
+        pendingReload.buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        reloadStage.store(2, memory_order_release);
+    }
+
+    // GL thread: re-upload what changed and swap in the rebuilt mesh
+    void applyReload() {
+        unique_ptr<ObjLoader> next = move(pendingReload.loader);
+        if (next->indexed.triangleCount() == 0 || (quantizedResident && next->quantized.empty())) {
+            printf("ObjLoader: reload of %s has no triangles, keeping the previous mesh\n", sourcePath.c_str());
+            return;
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        size_t uploaded = 0, total = 0, ranges = 0;
+        if (vertexBuffer != 0) {
+            const BufferDelta* deltas[3] = { &pendingReload.vertices, &pendingReload.indices, &pendingReload.edges };
+            BufferParts parts[3] = { next->vertexParts(quantizedResident), next->indexParts(), next->edgeParts() };
+            if (edgeBuffer == 0) {
+                glGenBuffers(1, &edgeBuffer);
+            }
+            GLuint buffers[3] = { vertexBuffer, indexBuffer, edgeBuffer };
+            GLenum targets[3] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER };
+            for (int b = 0; b < 3; b++) {
+                patchBuffer(targets[b], buffers[b], *deltas[b], parts[b]);
+                uploaded += deltas[b]->uploadBytes();
+                total += deltas[b]->bytes;
+                ranges += deltas[b]->full ? 1 : deltas[b]->ranges.size();
+            }
+            // A flat buffer means the stream existed when the rebuild
+            // started, so the rebuild made its replacement too
+            if (flatVertexBuffer != 0) {
+                patchBuffer(GL_ARRAY_BUFFER, flatVertexBuffer, pendingReload.flat, next->flatParts());
+                uploaded += pendingReload.flat.uploadBytes();
+                total += pendingReload.flat.bytes;
+                ranges += pendingReload.flat.full ? 1 : pendingReload.flat.ranges.size();
+            }
+        }
+        swap(mesh, next->mesh);
+        swap(indexed, next->indexed);
+        swap(quantized, next->quantized);
+        swap(faceNormals, next->faceNormals);
+        swap(flatVertices, next->flatVertices);
+        swap(edges, next->edges);
+        swap(meshlets, next->meshlets);
+        visibleRanges.clear();
+        meshBounds = next->meshBounds;
+        minX = next->minX, minY = next->minY, minZ = next->minZ;
+        maxX = next->maxX, maxY = next->maxY, maxZ = next->maxZ;
+        swapTextures(*next);
+        double uploadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        printf("ObjLoader: reloaded %s: rebuilt in %.1f ms, re-uploaded %.1f of %.1f KB in %zu ranges in %.2f ms, "
+            "%.1f ms from save to the first frame drawing it\n", sourcePath.c_str(), pendingReload.buildMs,
+            uploaded / 1024.0, total / 1024.0, ranges, uploadMs,
+            chrono::duration<double, milli>(chrono::steady_clock::now() - pendingReload.changedAt).count());
+    }
+
+    // Take over the rebuilt loader's textures. Acquiring the new ones before
+    // releasing the old keeps unchanged images resident (cache hits); only
+    // edited files are decoded and uploaded again.
+    void swapTextures(ObjLoader& next) {
+        if (textureResident) {
+            GLuint texture = next.textureHashed ? acquireImage(texturePath, next.textureHash, next.grassImg, GL_CLAMP) : 0;
+            textureCache().release(textures[0]);
+            textures[0] = texture;
+            for (size_t m = 0; m < next.materialSlots.size(); m++) {
+                MaterialSlot& slot = next.materialSlots[m];
+                if (slot.textureHashed) {
+                    slot.texture = acquireImage(slot.texturePath, slot.textureHash, slot.image, GL_REPEAT);
+                    slot.image.release();
+                }
+            }
+            for (size_t m = 0; m < materialSlots.size(); m++) {
+                textureCache().release(materialSlots[m].texture);
+            }
+        }
+        else {
+            swap(grassImg, next.grassImg);
+        }
+        textureHashed = next.textureHashed;
+        textureHash = next.textureHash;
+        swap(materialSlots, next.materialSlots);
+        boundTexture = ~(GLuint)0;
+    }
+
+    // glBufferData for a full delta, otherwise one glBufferSubData per range
+    // (ranges never straddle parts)
+    static void patchBuffer(GLenum target, GLuint buffer, const BufferDelta& delta, const BufferParts& parts) {
+        glBindBuffer(target, buffer);
+        if (delta.full) {
+            glBufferData(target, delta.bytes, NULL, GL_STATIC_DRAW);
+        }
+        size_t base = 0;
+        for (size_t p = 0; p < parts.size(); p++) {
+            const char* data = (const char*)parts[p].first;
+            size_t bytes = parts[p].second;
+            if (delta.full && bytes != 0) {
+                glBufferSubData(target, base, bytes, data);
+            }
+            for (size_t r = 0; !delta.full && r < delta.ranges.size(); r++) {
+                const BufferRange& range = delta.ranges[r];
+                if (range.offset >= base && range.offset < base + bytes) {
+                    glBufferSubData(target, range.offset, range.size, data + (range.offset - base));
+                }
+            }
+            base += bytes;
+        }
+        glBindBuffer(target, 0);
+    }
+
+    // The CPU arrays behind each buffer, in buffer order
+    BufferParts vertexParts(bool quantizedStream) const {
+        if (quantizedStream) {
+            return BufferParts(1, make_pair((const void*)quantized.vertices.data(), quantized.vertices.size() * sizeof(QuantizedVertex)));
+        }
+        return BufferParts(1, make_pair((const void*)indexed.vertices.data(), indexed.vertices.size() * sizeof(MeshVertex)));
+    }
+    BufferParts indexParts() const {
+        BufferParts parts(1, make_pair((const void*)indexed.indices.data(), indexed.indices.size() * sizeof(uint32_t)));
+        parts.push_back(make_pair((const void*)indexed.lodIndices.data(), indexed.lodIndices.size() * sizeof(uint32_t)));
+        return parts;
+    }
+    BufferParts edgeParts() const {
+        return BufferParts(1, make_pair((const void*)edges.indices.data(), edges.indices.size() * sizeof(uint32_t)));
+    }
+    BufferParts flatParts() const {
+        return BufferParts(1, make_pair((const void*)flatVertices.data(), flatVertices.size() * sizeof(MeshVertex)));
+    }
+
+    // Look the usemtl names up in the OBJ's material libraries and decode
+    // their textures, each image file once
+    void loadMaterials(const string& filename) {
+        materialSlots.assign(indexed.materials.size(), MaterialSlot());
+        if (indexed.materials.empty()) {
+            return;
+        }
+        vector<ObjMaterial> library;
+        for (size_t i = 0; i < indexed.materialLibraries.size(); i++) {
+            string path = objResolvePath(filename, indexed.materialLibraries[i]);
+            if (!objParseMaterialLibrary(path, library)) {
+                printf("ObjLoader: could not open material library %s\n", path.c_str());
+            }
+        }
+        size_t textured = 0, decoded = 0;
+        for (size_t m = 0; m < indexed.materials.size(); m++) {
+            MaterialSlot& slot = materialSlots[m];
+            const ObjMaterial* material = NULL;
+            for (size_t j = 0; j < library.size() && material == NULL; j++) {
+                if (library[j].name == indexed.materials[m]) {
+                    material = &library[j];
+                }
+            }
+            if (material == NULL) {
+                printf("ObjLoader: material %s not found\n", indexed.materials[m].c_str());
+                continue;
+            }
+            memcpy(slot.diffuse, material->diffuse, sizeof(slot.diffuse));
+            slot.hasDiffuse = material->hasDiffuse;
+            if (material->diffuseMap.empty()) {
+                continue;
+            }
+            slot.texturePath = material->diffuseMap;
+            slot.textureHashed = TextureCache::hashFile(slot.texturePath, slot.textureHash);
+            if (!slot.textureHashed) {
+                printf("ObjLoader: could not read %s\n", slot.texturePath.c_str());
+                continue;
+            }
+            textured++;
+            // Materials sharing an image get it from the cache at upload
+            bool shared = textureCache().contains(slot.texturePath, slot.textureHash);
+            for (size_t k = 0; k < m && !shared; k++) {
+                shared = materialSlots[k].textureHashed && materialSlots[k].textureHash == slot.textureHash &&
+                    materialSlots[k].texturePath == slot.texturePath;
+            }
+            if (!shared) {
+                decodeImage(slot.texturePath, slot.image);
+                decoded++;
+            }
+        }
+        printf("ObjLoader: %zu materials in %zu subsets, %zu textured, %zu images decoded\n",
+            indexed.materials.size(), indexed.subsetsPerLevel(), textured, decoded);
+    }
+
+    // The cooker's error bound for the quantized stream
+    void printQuantization() const {
+        float extent = 0.0f;
+        for (int k = 0; k < 3 && !meshBounds.empty(); k++) {
+            extent = fmaxf(extent, meshBounds.max[k] - meshBounds.min[k]);
+        }
+        printf("ObjLoader: quantized %zu -> %zu bytes/vertex, max error position %.6g (%.4f%% of extent), uv %.6g, normal %.3f deg\n",
+            sizeof(MeshVertex), sizeof(QuantizedVertex), quantized.error.position,
+            extent > 0.0f ? 100.0f * quantized.error.position / extent : 0.0f, quantized.error.uv, quantized.error.normal);
+    }
+
+    void decodeTexture() {
+        grassImg = cv::imread(texturePath);
+        if (grassImg.empty()) {
+           std::cout << "grassImg empty\n";
+        }
+        else {
+            cv::flip(grassImg, grassImg, 0);
+        }
+    }
+    static void decodeImage(const string& path, cv::Mat& image) {
+        image = cv::imread(path);
+        if (image.empty()) {
+            printf("ObjLoader: could not decode %s\n", path.c_str());
+        }
+        else {
+            cv::flip(image, image, 0);
+        }
+    }
+
+    // The cached texture for (path, hash); on a miss `image` (decoded again
+    // if it was dropped since load() checked) is uploaded with a mip chain
+    GLuint acquireImage(const string& path, uint64_t hash, cv::Mat& image, GLint wrap) {
+        return textureCache().acquire(path, hash, [&path, &image, wrap](GLuint) -> size_t {
+            if (image.empty()) {
+                decodeImage(path, image);
+            }
+            if (image.empty()) {
+                return 0;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+            MipmapOptions options = mipOptionsForContext();
+            options.wrap = wrap == GL_REPEAT;
+            MipChain mips;
+            if (!mipBuild(image.ptr(), image.cols, image.rows, 3, image.step, options, mips)) {
+                return 0;
+            }
+            mipUpload(mips, GL_RGB, GL_BGR_EXT);
+            textureUploadCount()++;
+            return mips.bytes();
+        });
+    }
+
+    int subsetMaterial(int lod, int subset) const {
+        return indexed.subsets.empty() ? -1 : indexed.levelSubsets(lod)[subset].material;
+    }
+    GLuint materialTexture(int material) const {
+        if (material >= 0 && material < (int)materialSlots.size() && materialSlots[material].texture != 0) {
+            return materialSlots[material].texture;
+        }
+        return textures[0];
+    }
+    void bindTexture(GLuint texture) {
+        if (texture != boundTexture) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            boundTexture = texture;
+            textureBinds++;
+        }
+    }
+    // Texture and, outside shadow passes, the Kd colour of a subset's material
+    void bindSubsetMaterial(int lod, int subset, int shadowMode) {
+        if (shadowMode != 0) {
+            return;
+        }
+        bindSubsetTexture(lod, subset);
+        int material = subsetMaterial(lod, subset);
+        if (material >= 0 && material < (int)materialSlots.size() && materialSlots[material].hasDiffuse) {
+            glColor3fv(materialSlots[material].diffuse);
+        }
+        else {
+            glColor3f(defaultColorFace[0], defaultColorFace[1], defaultColorFace[2]);
+        }
+    }
+
+    // Parse, triangulate, weld and optimise the OBJ text
+    void loadObj(const string& filename, const ObjLoadOptions& options) {
+        ObjParseStats stats;
+        if (!objParseFile(filename, mesh, &stats, 0)) {
+            printf("Error opening file!\n");
+        }
+        else {
+            printf("ObjLoader: %s %.2f MB in %.2f ms (%.1f MB/s, %d threads)\n", filename.c_str(),
+                stats.bytes / (1024.0 * 1024.0), stats.seconds * 1000.0, stats.megabytesPerSecond(), stats.threads);
+        }
+        TriangulateStats triangulated = meshTriangulate(mesh);
+        if (triangulated.polygons != 0 || triangulated.dropped != 0) {
+            printf("ObjLoader: triangulated %zu polygons (%zu concave), dropped %zu degenerate faces\n",
+                triangulated.polygons, triangulated.concave, triangulated.dropped);
+        }
+        if (meshGenerateNormals(mesh)) {
+            printf("ObjLoader: no vn for some corners, generated smooth normals\n");
+        }
+        mesh.shrinkToFit();
+        meshWeld(mesh, indexed);
+        if (options.optimizeVertexCache) {
+            VertexCacheStats before, after;
+            meshOptimize(indexed, &before, &after);
+            printf("ObjLoader: vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                before.acmr, after.acmr, before.atvr, after.atvr);
+        }
+        printf("ObjLoader: %zu positions, %zu faces welded into %zu vertices\n",
+            mesh.positionCount(), mesh.faceCount(), indexed.vertexCount());
+        if (options.lodLevels > 1) {
+            meshBuildLodChain(indexed, options.lodLevels);
+            printf("ObjLoader: LOD triangles");
+            for (size_t l = 0; l < indexed.lods.size(); l++) {
+                printf(" %u (%.4f)", indexed.lods[l].indexCount / 3, indexed.lods[l].error);
+            }
+            printf("\n");
+        }
+
+        meshBounds = meshComputeBounds(mesh.positions.data(), mesh.positionCount());
+    }
+
     void drawCube() {
         glLineWidth(1.0f);
         glBegin(GL_LINES);
@@ -333,134 +1065,263 @@ private:
 
         glEnd();
     }
+    // Set the vertex array pointers for an interleaved MeshVertex stream,
+    // either into a VBO (offsets) or into system memory when buffer is 0.
+    void bindVertexArrays(GLuint buffer, const MeshVertex* clientVertices, bool texcoords, bool normals) {
+        const char* base = NULL;
+        if (buffer != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        }
+        else {
+            base = (const char*)clientVertices;
+        }
+        GLsizei stride = sizeof(MeshVertex);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, stride, base + offsetof(MeshVertex, px));
+        if (texcoords) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_FLOAT, stride, base + offsetof(MeshVertex, u));
+        }
+        if (normals) {
+            glEnableClientState(GL_NORMAL_ARRAY);
+            glNormalPointer(GL_FLOAT, stride, base + offsetof(MeshVertex, nx));
+        }
+    }
+    void bindVertexArrays(bool texcoords, bool normals) {
+        if (quantizedResident) {
+            bindQuantizedArrays(texcoords, normals);
+        }
+        else {
+            bindVertexArrays(vertexBuffer, indexed.vertices.data(), texcoords, normals);
+        }
+    }
+    // QuantizedVertex stream: int16 positions and UVs through the classic
+    // arrays (scaled back by the shader or by pushQuantizationMatrix), the
+    // octahedral normal through a generic attribute only the shader reads
+    void bindQuantizedArrays(bool texcoords, bool normals) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        GLsizei stride = sizeof(QuantizedVertex);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_SHORT, stride, (const GLvoid*)offsetof(QuantizedVertex, px));
+        if (texcoords) {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_SHORT, stride, (const GLvoid*)offsetof(QuantizedVertex, u));
+        }
+        if (normals) {
+            glEnableVertexAttribArray(MESH_OCT_NORMAL_ATTRIB);
+            glVertexAttribPointer(MESH_OCT_NORMAL_ATTRIB, 2, GL_SHORT, GL_FALSE, stride, (const GLvoid*)offsetof(QuantizedVertex, octX));
+        }
+    }
+    // Fixed-function draws of a quantized buffer: fold the dequantization
+    // scale and offset into the modelview. The normal matrix then gains the
+    // inverse of that scale, so the current normal is pre-scaled by it and
+    // lights exactly as with float vertices.
+    void pushQuantizationMatrix() {
+        glPushMatrix();
+        if (quantizedResident) {
+            const QuantizationParams& q = quantized.params;
+            GLfloat normal[3];
+            glPushAttrib(GL_CURRENT_BIT);
+            glGetFloatv(GL_CURRENT_NORMAL, normal);
+            glNormal3f(normal[0] * q.positionScale[0], normal[1] * q.positionScale[1], normal[2] * q.positionScale[2]);
+            glTranslatef(q.positionOffset[0], q.positionOffset[1], q.positionOffset[2]);
+            glScalef(q.positionScale[0], q.positionScale[1], q.positionScale[2]);
+        }
+    }
+    void popQuantizationMatrix() {
+        if (quantizedResident) {
+            glPopAttrib();
+        }
+        glPopMatrix();
+    }
+    void unbindVertexArrays() {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        if (quantizedResident) {
+            glDisableVertexAttribArray(MESH_OCT_NORMAL_ATTRIB);
+        }
+        if (vertexBuffer != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    }
+    // Pick a level from the bounding sphere's projected diameter in pixels
+    // under the current modelview/projection: LOD 0 at lodFullDetailPixels
+    // and above, one level coarser each time the diameter halves.
+    int selectLod() const {
+        if (indexed.lods.size() < 2) {
+            return 0;
+        }
+        GLfloat modelview[16], projection[16];
+        GLint viewport[4];
+        glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+        glGetFloatv(GL_PROJECTION_MATRIX, projection);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        const float* center = meshBounds.center;
+        float radius = meshBounds.radius;
+        // Largest axis scale of the modelview carries the radius into eye space
+        float scale = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            float s = sqrtf(modelview[c * 4] * modelview[c * 4] + modelview[c * 4 + 1] * modelview[c * 4 + 1] +
+                modelview[c * 4 + 2] * modelview[c * 4 + 2]);
+            scale = s > scale ? s : scale;
+        }
+        float eyeRadius = radius * scale;
+        // Diameter in NDC is 2 * r * projection[5] (/ distance for perspective),
+        // and NDC spans viewport[3] / 2 pixels per unit
+        float pixels = eyeRadius * projection[5] * viewport[3];
+        if (projection[11] != 0.0f) {
+            float distance = -(modelview[2] * center[0] + modelview[6] * center[1] + modelview[10] * center[2] + modelview[14]);
+            if (distance <= eyeRadius) {
+                return 0; // camera inside or touching the sphere
+            }
+            pixels /= distance;
+        }
+        return lodForPixels(pixels);
+    }
+
+    // Reject the meshlets outside the current view, or facing away from it
+    // when back faces are being culled, and keep the surviving ranges
+    void cullMeshlets() {
+        GLfloat modelview[16], projection[16];
+        glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+        glGetFloatv(GL_PROJECTION_MATRIX, projection);
+        GLint cullFace = GL_BACK, frontFace = GL_CCW;
+        glGetIntegerv(GL_CULL_FACE_MODE, &cullFace);
+        glGetIntegerv(GL_FRONT_FACE, &frontFace);
+        bool backfaceCull = glIsEnabled(GL_CULL_FACE) && cullFace == GL_BACK && frontFace == GL_CCW;
+        meshCullMeshlets(meshlets, meshMeshletView(modelview, projection, backfaceCull), visibleRanges, cullStats);
+    }
+    // The current LOD as triangles, one material subset after the other
+    // (with its texture and colour when `materials`), and at LOD 0 with
+    // meshlets only the parts of each subset that survive culling. `flat`
+    // draws the same triangles from the bound flat-shading stream, whose
+    // vertex ranges match the index ranges.
+    void drawTriangles(bool flat, bool materials, int shadowMode) {
+        int level = currentLod;
+        bool culled = currentLod == 0 && !meshlets.empty();
+        if (culled) {
+            cullMeshlets();
+        }
+        for (int s = 0; s < subsetCount(); s++) {
+            uint32_t offset = indexed.subsets.empty() ? (indexed.lods.empty() ? 0 : indexed.lods[level].indexOffset)
+                : indexed.levelSubsets(level)[s].indexOffset;
+            uint32_t count = (uint32_t)subsetIndexCount(level, s);
+            size_t ranges = culled ? clipVisibleRanges(offset, count) : 1;
+            if (count == 0 || ranges == 0) {
+                continue;
+            }
+            if (materials) {
+                bindSubsetMaterial(level, s, shadowMode);
+            }
+            if (!culled) {
+                if (flat) {
+                    glDrawArrays(GL_TRIANGLES, (GLint)offset, (GLsizei)count);
+                }
+                else {
+                    glDrawElements(GL_TRIANGLES, (GLsizei)count, GL_UNSIGNED_INT, indexPointer(offset));
+                }
+            }
+            else if (GLEE_VERSION_1_4) {
+                if (flat) {
+                    glMultiDrawArrays(GL_TRIANGLES, rangeFirsts.data(), rangeCounts.data(), (GLsizei)ranges);
+                }
+                else {
+                    glMultiDrawElements(GL_TRIANGLES, rangeCounts.data(), GL_UNSIGNED_INT, rangePointers.data(), (GLsizei)ranges);
+                }
+            }
+            else {
+                for (size_t i = 0; i < ranges; i++) {
+                    if (flat) {
+                        glDrawArrays(GL_TRIANGLES, rangeFirsts[i], rangeCounts[i]);
+                    }
+                    else {
+                        glDrawElements(GL_TRIANGLES, rangeCounts[i], GL_UNSIGNED_INT, rangePointers[i]);
+                    }
+                }
+            }
+        }
+    }
+    // The surviving meshlet ranges within [offset, offset + count), as draw
+    // arguments; meshlets never straddle a subset, so clipping only drops
+    // whole ranges or trims merged ones
+    size_t clipVisibleRanges(uint32_t offset, uint32_t count) {
+        rangeCounts.clear();
+        rangeFirsts.clear();
+        rangePointers.clear();
+        for (size_t i = 0; i < visibleRanges.size(); i++) {
+            uint32_t first = max(visibleRanges[i].indexOffset, offset);
+            uint32_t last = min(visibleRanges[i].indexOffset + visibleRanges[i].indexCount, offset + count);
+            if (first >= last) {
+                continue;
+            }
+            rangeCounts.push_back((GLsizei)(last - first));
+            rangeFirsts.push_back((GLint)first);
+            rangePointers.push_back(indexPointer(first));
+        }
+        return rangeCounts.size();
+    }
+
     void drawModePoint() {
         glPointSize(3.0f);
-        glBegin(GL_POINTS);
         if (colorMode == 0) {
             glColor3f(defaultColorPoint[0], defaultColorPoint[1], defaultColorPoint[2]);
         }
         else {
             glColor3f(RandomColor[0], RandomColor[1], RandomColor[2]);
         }
-        
-        for (int i = 0; i < v.size(); i++) {
-            glVertex3f(v[i][0], v[i][1], v[i][2]);
-        }
-        glEnd();
+        pushQuantizationMatrix();
+        bindVertexArrays(false, false);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)indexed.vertexCount());
+        unbindVertexArrays();
+        popQuantizationMatrix();
     }
     void drawModeLine() {
         glLineWidth(1.0f);
-        glBegin(GL_LINES);
         if (colorMode == 0) {
             glColor3f(defaultColorLine[0], defaultColorLine[1], defaultColorLine[2]);
         }
         else {
             glColor3f(RandomColor[0], RandomColor[1], RandomColor[2]);
         }
-        for (int i = 0; i < f.size(); i++) {
-            //�T���I
-            vertex a, b, c, normal;
-
-            if ((f[i]).size() != 3) {
-                cout << "ERRER::THE SIZE OF f IS NOT 3!" << endl;
-            }
-            else {
-                GLint firstVertexIndex = (f[i])[0];
-                GLint secondVertexIndex = (f[i])[1];
-                GLint thirdVertexIndex = (f[i])[2];
-
-                a.x = (v[firstVertexIndex])[0]; // 1
-                a.y = (v[firstVertexIndex])[1];
-                a.z = (v[firstVertexIndex])[2];
-
-                b.x = (v[secondVertexIndex])[0]; // 2
-                b.y = (v[secondVertexIndex])[1];
-                b.z = (v[secondVertexIndex])[2];
-
-                c.x = (v[thirdVertexIndex])[0]; // 3
-                c.y = (v[thirdVertexIndex])[1];
-                c.z = (v[thirdVertexIndex])[2];
-
-                glVertex3f(a.x, a.y, a.z); 
-                glVertex3f(b.x, b.y, b.z);
-
-                glVertex3f(b.x, b.y, b.z);
-                glVertex3f(c.x, c.y, c.z);
-
-                glVertex3f(a.x, a.y, a.z);
-                glVertex3f(c.x, c.y, c.z);
-            }
+        if (edges.levels.empty()) {
+            return;
         }
-
-        glEnd();
+        // Every edge of the current LOD once, from the edge IBO
+        const MeshLod& level = edges.levels[currentLod];
+        pushQuantizationMatrix();
+        bindVertexArrays(false, false);
+        const GLvoid* first = edges.indices.data() + level.indexOffset;
+        if (vertexBuffer != 0) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, edgeBuffer);
+            first = (const GLvoid*)(level.indexOffset * sizeof(uint32_t));
+        }
+        glDrawElements(GL_LINES, (GLsizei)level.indexCount, GL_UNSIGNED_INT, first);
+        unbindVertexArrays();
+        popQuantizationMatrix();
     }
     void drawModeFace(int shadowMode) {
-        glBegin(GL_TRIANGLES);
         if (shadowMode == 0) {
             glColor3f(defaultColorFace[0], defaultColorFace[1], defaultColorFace[2]);
         }
         else { // is shadow
             glColor4d(0.0, 0.0, 0.0, 0.6);
         }
-        for (int i = 0; i < f.size(); i++) {
-            vertex a, b, c, normala, normalb, normalc, normal;
-
-            if ((f[i]).size() != 3) {
-                cout << "ERRER::THE SIZE OF f IS NOT 3!" << endl;
-            }
-            else {
-                GLint firstVertexIndex = (f[i])[0];
-                GLint secondVertexIndex = (f[i])[1];
-                GLint thirdVertexIndex = (f[i])[2];
-
-                a.x = (v[firstVertexIndex])[0];
-                a.y = (v[firstVertexIndex])[1];
-                a.z = (v[firstVertexIndex])[2];
-
-                b.x = (v[secondVertexIndex])[0];
-                b.y = (v[secondVertexIndex])[1];
-                b.z = (v[secondVertexIndex])[2];
-
-                c.x = (v[thirdVertexIndex])[0];
-                c.y = (v[thirdVertexIndex])[1];
-                c.z = (v[thirdVertexIndex])[2];
-
-                GLint firstNormalIndex = (fvn[i])[0];
-                GLint secondNormalIndex = (fvn[i])[1];
-                GLint thirdNormalIndex = (fvn[i])[2];
-
-                normala.x = (vn[firstNormalIndex])[0];
-                normala.y = (vn[firstNormalIndex])[1];
-                normala.z = (vn[firstNormalIndex])[2];
-
-                normalb.x = (vn[secondNormalIndex])[0];
-                normalb.y = (vn[secondNormalIndex])[1];
-                normalb.z = (vn[secondNormalIndex])[2];
-
-                normalc.x = (vn[thirdNormalIndex])[0];
-                normalc.y = (vn[thirdNormalIndex])[1];
-                normalc.z = (vn[thirdNormalIndex])[2];
-
-                normal.x = (normala.x + normalb.x + normalc.x) / 3;
-                normal.y = (normala.y + normalb.y + normalc.y) / 3;
-                normal.z = (normala.z + normalb.z + normalc.z) / 3;
-
-                GLint firstTextureIndex = (fvt[i])[0];
-                GLint secondTextureIndex = (fvt[i])[1];
-                GLint thirdTextureIndex = (fvt[i])[2];
-
-                glNormal3f(normal.x, normal.y, normal.z);
-                glBindTexture(GL_TEXTURE_2D, textures[0]);
-                glTexCoord2f( (vt[firstTextureIndex])[0], (vt[firstTextureIndex])[1]);
-                glVertex3f(a.x, a.y, a.z);
-                glTexCoord2f( (vt[secondTextureIndex])[0], (vt[secondTextureIndex])[1]);
-                glVertex3f(b.x, b.y, b.z);
-                glTexCoord2f( (vt[thirdTextureIndex])[0], (vt[thirdTextureIndex])[1]);
-                glVertex3f(c.x, c.y, c.z);
-                
-            }
+        init();
+        if (shadeMode == 1 && !flatVertices.empty()) {
+            bindVertexArrays(flatVertexBuffer, flatVertices.data(), true, true);
+            drawTriangles(true, true, shadowMode);
         }
-
-        glEnd();
+        else {
+            beginShading(shadowMode);
+            bindVertexArrays(true, true);
+            drawTriangles(false, true, shadowMode);
+            endShading();
+        }
+        unbindVertexArrays();
     }
 };
@@ -0,0 +1,72 @@
+#pragma once
+// objMaterials.h
+// Reader for the parts of Wavefront .mtl material libraries the scene can
+// shade: the diffuse colour (Kd) and diffuse texture (map_Kd) of each newmtl.
+// Texture paths are resolved relative to the .mtl file, library paths
+// relative to the OBJ. No GL here; ObjLoader uploads the images.
+#include <string>
+#include <vector>
+#include "objParser.h"
+
+struct ObjMaterial
+{
+    std::string name;
+    float diffuse[3] = {1.0f, 1.0f, 1.0f};
+    bool hasDiffuse = false;  // Kd was given
+    std::string diffuseMap;   // resolved map_Kd path, empty if none
+};
+
+// `path` as seen from the file `relativeTo`: absolute paths are kept, others
+// are taken from relativeTo's directory
+inline std::string objResolvePath(const std::string &relativeTo, const std::string &path)
+{
+    if (path.empty() || path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'))
+        return path;
+    size_t slash = relativeTo.find_last_of("/\\");
+    return slash == std::string::npos ? path : relativeTo.substr(0, slash + 1) + path;
+}
+
+// Append the materials of one library to `out`. Returns false if the file
+// can't be opened.
+inline bool objParseMaterialLibrary(const std::string &filename, std::vector<ObjMaterial> &out)
+{
+    MappedFile file(filename);
+    if (!file.isOpen())
+        return false;
+    const char *p = file.data(), *end = file.data() + file.size();
+    ObjMaterial *current = NULL;
+    while (p < end)
+    {
+        p = objSkipSpaces(p, end);
+        if (objIsKeyword(p, end, "newmtl", 6))
+        {
+            out.push_back(ObjMaterial());
+            current = &out.back();
+            current->name = objLineArgument(p + 6, end);
+        }
+        else if (current != NULL && objIsKeyword(p, end, "Kd", 2))
+        {
+            // "Kd r g b", or "Kd v" for a grey
+            const char *q = p + 2;
+            int count = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                const char *start = objSkipSpaces(q, end);
+                q = objParseFloat(start, end, current->diffuse[k]);
+                count += q != start;
+            }
+            if (count == 1)
+                current->diffuse[1] = current->diffuse[2] = current->diffuse[0];
+            current->hasDiffuse = true;
+        }
+        else if (current != NULL && objIsKeyword(p, end, "map_Kd", 6))
+        {
+            // Options such as -s or -clamp may come first; the file name is last
+            std::string argument = objLineArgument(p + 6, end);
+            size_t blank = argument.find_last_of(" \t");
+            current->diffuseMap = objResolvePath(filename, blank == std::string::npos ? argument : argument.substr(blank + 1));
+        }
+        p = objSkipLine(p, end);
+    }
+    return true;
+}
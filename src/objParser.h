@@ -0,0 +1,568 @@
+#pragma once
+// objParser.h
+// Zero-copy Wavefront OBJ parser used by ObjLoader.
+// The source file is memory mapped and scanned in place; numbers are read
+// with a small hand-written tokenizer so no per-line strings or streams
+// are created. Nothing in here touches OpenGL, so it can be used headless.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include "mappedFile.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A usemtl or g/o switch: faces from firstFace on use name `index` until
+// the next run. Faces before the first run have none (-1).
+struct ObjFaceRun
+{
+    int firstFace;
+    int index;
+};
+
+// Parsed OBJ data, stored flat.
+// Face i uses corners [faceOffsets[i], faceOffsets[i + 1]). Corner indices are
+// 0-based and absolute (relative ones are resolved); a missing vt or vn index
+// is stored as -1.
+struct ObjMeshData
+{
+    std::vector<float> positions; // x y z
+    std::vector<float> texcoords; // u v
+    std::vector<float> normals;   // x y z
+    std::vector<int> faceOffsets;
+    std::vector<int> cornerV;
+    std::vector<int> cornerVT;
+    std::vector<int> cornerVN;
+    std::vector<std::string> materialLibraries; // mtllib file names as written
+    std::vector<std::string> materialNames;     // usemtl names, in order of first use
+    std::vector<std::string> groupNames;        // g and o names, in order of first use
+    std::vector<ObjFaceRun> materialRuns;       // into materialNames
+    std::vector<ObjFaceRun> groupRuns;          // into groupNames
+    // Relative indices seen by objParseBuffer(), as corner * 3 + (0 v, 1 vt,
+    // 2 vn). They were resolved against this buffer's own counts, which a
+    // chunk of a parallel parse must rebase; empty after a complete parse.
+    std::vector<uint32_t> relativeCorners;
+
+    size_t positionCount() const { return positions.size() / 3; }
+    size_t texcoordCount() const { return texcoords.size() / 2; }
+    size_t normalCount() const { return normals.size() / 3; }
+    size_t faceCount() const { return faceOffsets.empty() ? 0 : faceOffsets.size() - 1; }
+    size_t cornerCount() const { return cornerV.size(); }
+
+    // Bytes allocated by the arrays (capacity, not size)
+    size_t memoryFootprint() const
+    {
+        return positions.capacity() * sizeof(float) + texcoords.capacity() * sizeof(float) +
+               normals.capacity() * sizeof(float) + faceOffsets.capacity() * sizeof(int) +
+               (cornerV.capacity() + cornerVT.capacity() + cornerVN.capacity()) * sizeof(int);
+    }
+
+    void shrinkToFit()
+    {
+        positions.shrink_to_fit();
+        texcoords.shrink_to_fit();
+        normals.shrink_to_fit();
+        faceOffsets.shrink_to_fit();
+        cornerV.shrink_to_fit();
+        cornerVT.shrink_to_fit();
+        cornerVN.shrink_to_fit();
+    }
+
+    void clear()
+    {
+        positions.clear();
+        texcoords.clear();
+        normals.clear();
+        faceOffsets.clear();
+        cornerV.clear();
+        cornerVT.clear();
+        cornerVN.clear();
+        materialLibraries.clear();
+        materialNames.clear();
+        groupNames.clear();
+        materialRuns.clear();
+        groupRuns.clear();
+        relativeCorners.clear();
+    }
+};
+
+// Index of `name` in `names`, appended if new. Few names per file, so a
+// linear scan is fine.
+inline int objNameIndex(std::vector<std::string> &names, const std::string &name)
+{
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == name)
+            return (int)i;
+    names.push_back(name);
+    return (int)names.size() - 1;
+}
+
+// Start a run at the next face; a run that would cover no faces is replaced
+inline void objAddRun(std::vector<ObjFaceRun> &runs, int firstFace, int index)
+{
+    if (!runs.empty() && runs.back().firstFace == firstFace)
+        runs.pop_back();
+    if (!runs.empty() && runs.back().index == index)
+        return;
+    ObjFaceRun run = {firstFace, index};
+    runs.push_back(run);
+}
+
+// Name index per face from a run list, for faceCount faces
+inline void objExpandRuns(const std::vector<ObjFaceRun> &runs, size_t faceCount, std::vector<int> &out)
+{
+    out.assign(faceCount, -1);
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        size_t end = r + 1 < runs.size() ? (size_t)runs[r + 1].firstFace : faceCount;
+        for (size_t f = runs[r].firstFace; f < end && f < faceCount; f++)
+            out[f] = runs[r].index;
+    }
+}
+
+struct ObjParseStats
+{
+    size_t bytes = 0;
+    double seconds = 0.0;
+    int threads = 1;
+
+    double megabytesPerSecond() const
+    {
+        return seconds > 0.0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Tokenizer
+
+inline bool objIsDigit(char c) { return (unsigned)(c - '0') < 10u; }
+
+inline const char *objSkipSpaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+inline const char *objSkipLine(const char *p, const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+// True if [p, end) starts with `keyword` followed by a blank
+inline bool objIsKeyword(const char *p, const char *end, const char *keyword, size_t length)
+{
+    return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+// Rest of the line after the keyword, without surrounding blanks or the \r
+inline std::string objLineArgument(const char *p, const char *end)
+{
+    p = objSkipSpaces(p, end);
+    const char *e = p;
+    while (e < end && *e != '\n')
+        e++;
+    while (e > p && (e[-1] == '\r' || e[-1] == ' ' || e[-1] == '\t'))
+        e--;
+    return std::string(p, e);
+}
+
+// Exact powers of ten representable as double
+inline double objPow10(int e)
+{
+    static const double table[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (e >= 0 && e <= 22)
+        return table[e];
+    return pow(10.0, e);
+}
+
+// Reads [+-]digits[.digits][(e|E)[+-]digits]. Returns the position after the
+// number; on a malformed number `out` is 0 and p is returned unchanged.
+inline const char *objParseFloat(const char *p, const char *end, float &out)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;  // significant digits kept in mantissa
+    int exponent = 0;
+    bool any = false;
+    while (p < end && objIsDigit(*p))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0)
+                digits++;
+        }
+        else
+            exponent++;
+        any = true;
+        p++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && objIsDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+            any = true;
+            p++;
+        }
+    }
+    if (!any)
+    {
+        out = 0.0f;
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool expNegative = false;
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            expNegative = *q == '-';
+            q++;
+        }
+        if (q < end && objIsDigit(*q))
+        {
+            int e = 0;
+            while (q < end && objIsDigit(*q))
+            {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+                q++;
+            }
+            exponent += expNegative ? -e : e;
+            p = q;
+        }
+    }
+
+    double value = (double)mantissa;
+    if (exponent < 0)
+        value /= objPow10(-exponent);
+    else if (exponent > 0)
+        value *= objPow10(exponent);
+    out = (float)(negative ? -value : value);
+    return p;
+}
+
+inline const char *objParseInt(const char *p, const char *end, int &out)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    if (p >= end || !objIsDigit(*p))
+    {
+        out = 0;
+        return start;
+    }
+    // Saturates instead of overflowing; such an index is out of range anyway
+    int value = 0;
+    while (p < end && objIsDigit(*p))
+    {
+        value = value < 100000000 ? value * 10 + (*p - '0') : 1000000000;
+        p++;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Parser
+
+// 1-based OBJ index to 0-based: positive counts from the start of the file,
+// negative back from the last element defined so far, 0 (absent) gives -1
+inline int objResolveIndex(int index, size_t count, ObjMeshData &mesh, uint32_t attribute)
+{
+    if (index >= 0)
+        return index - 1;
+    mesh.relativeCorners.push_back((uint32_t)mesh.cornerV.size() * 3 + attribute);
+    return (int)count + index;
+}
+
+// One face corner: v, v/vt, v//vn or v/vt/vn, each index possibly negative
+inline const char *objParseCorner(const char *p, const char *end, ObjMeshData &mesh)
+{
+    int v = 0, vt = 0, vn = 0;
+    p = objParseInt(p, end, v);
+    if (p < end && *p == '/')
+    {
+        p = objParseInt(p + 1, end, vt);
+        if (p < end && *p == '/')
+            p = objParseInt(p + 1, end, vn);
+    }
+    v = objResolveIndex(v, mesh.positionCount(), mesh, 0);
+    vt = objResolveIndex(vt, mesh.texcoordCount(), mesh, 1);
+    vn = objResolveIndex(vn, mesh.normalCount(), mesh, 2);
+    mesh.cornerV.push_back(v);
+    mesh.cornerVT.push_back(vt);
+    mesh.cornerVN.push_back(vn);
+    return p;
+}
+
+// Parse the OBJ records in [p, end). Unknown records are skipped.
+inline void objParseBuffer(const char *p, const char *end, ObjMeshData &mesh)
+{
+    if (mesh.faceOffsets.empty())
+        mesh.faceOffsets.push_back(0);
+
+    float x, y, z;
+    while (p < end)
+    {
+        p = objSkipSpaces(p, end);
+        if (p + 1 < end && *p == 'v')
+        {
+            char c = p[1];
+            if (c == ' ' || c == '\t')
+            {
+                p = objSkipSpaces(p + 2, end);
+                p = objSkipSpaces(objParseFloat(p, end, x), end);
+                p = objSkipSpaces(objParseFloat(p, end, y), end);
+                p = objParseFloat(p, end, z);
+                mesh.positions.push_back(x);
+                mesh.positions.push_back(y);
+                mesh.positions.push_back(z);
+            }
+            else if (c == 't')
+            {
+                p = objSkipSpaces(p + 2, end);
+                p = objSkipSpaces(objParseFloat(p, end, x), end);
+                p = objParseFloat(p, end, y);
+                mesh.texcoords.push_back(x);
+                mesh.texcoords.push_back(y);
+            }
+            else if (c == 'n')
+            {
+                p = objSkipSpaces(p + 2, end);
+                p = objSkipSpaces(objParseFloat(p, end, x), end);
+                p = objSkipSpaces(objParseFloat(p, end, y), end);
+                p = objParseFloat(p, end, z);
+                mesh.normals.push_back(x);
+                mesh.normals.push_back(y);
+                mesh.normals.push_back(z);
+            }
+        }
+        else if (p + 1 < end && *p == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            p += 2;
+            for (;;)
+            {
+                p = objSkipSpaces(p, end);
+                if (p >= end || !(objIsDigit(*p) || *p == '-' || *p == '+'))
+                    break;
+                const char *next = objParseCorner(p, end, mesh);
+                if (next == p)
+                    break;
+                p = next;
+            }
+            mesh.faceOffsets.push_back((int)mesh.cornerV.size());
+        }
+        else if (objIsKeyword(p, end, "usemtl", 6))
+        {
+            int index = objNameIndex(mesh.materialNames, objLineArgument(p + 6, end));
+            objAddRun(mesh.materialRuns, (int)mesh.faceCount(), index);
+        }
+        else if (objIsKeyword(p, end, "g", 1) || objIsKeyword(p, end, "o", 1))
+        {
+            int index = objNameIndex(mesh.groupNames, objLineArgument(p + 1, end));
+            objAddRun(mesh.groupRuns, (int)mesh.faceCount(), index);
+        }
+        else if (objIsKeyword(p, end, "mtllib", 6))
+        {
+            // Several files may be listed, separated by blanks
+            std::string line = objLineArgument(p + 6, end);
+            size_t start = 0;
+            while (start < line.size())
+            {
+                size_t stop = line.find_first_of(" \t", start);
+                if (stop == std::string::npos)
+                    stop = line.size();
+                if (stop > start)
+                    objNameIndex(mesh.materialLibraries, line.substr(start, stop - start));
+                start = stop + 1;
+            }
+        }
+        p = objSkipLine(p, end);
+    }
+}
+
+// Parallel parse: the buffer is cut into newline-aligned chunks which worker
+// threads parse into their own ObjMeshData. The chunks are then concatenated in
+// file order using prefix-summed offsets, so the result is identical to
+// objParseBuffer() on the whole range. Returns the number of threads used;
+// inputs under a few MB are parsed serially.
+inline int objParseBufferParallel(const char *begin, const char *end, ObjMeshData &mesh, int threadCount)
+{
+    const size_t minChunkBytes = 1 << 20;
+    size_t size = end - begin;
+    if (threadCount < 1)
+        threadCount = 1;
+    size_t chunkCount = (size_t)threadCount * 4;
+    if (chunkCount > size / minChunkBytes)
+        chunkCount = size / minChunkBytes;
+    if (threadCount == 1 || chunkCount < 2)
+    {
+        objParseBuffer(begin, end, mesh);
+        mesh.relativeCorners.clear(); // resolved against the whole file already
+        return 1;
+    }
+    // Workers beyond the chunk count would find nothing to do
+    if ((size_t)threadCount > chunkCount)
+        threadCount = (int)chunkCount;
+
+    // Chunk boundaries, each moved forward to the start of the next line
+    std::vector<const char *> cuts(chunkCount + 1);
+    cuts[0] = begin;
+    cuts[chunkCount] = end;
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        const char *p = begin + size * i / chunkCount;
+        if (p < cuts[i - 1])
+            p = cuts[i - 1];
+        cuts[i] = p > begin && p[-1] == '\n' ? p : objSkipLine(p, end);
+    }
+
+    std::vector<ObjMeshData> chunks(chunkCount);
+    std::atomic<size_t> nextChunk(0);
+    auto parseWorker = [&]() {
+        for (size_t i = nextChunk++; i < chunkCount; i = nextChunk++)
+            objParseBuffer(cuts[i], cuts[i + 1], chunks[i]);
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threadCount; t++)
+        workers.push_back(std::thread(parseWorker));
+    parseWorker();
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    // Prefix sums of every per-chunk array size
+    struct Offsets { size_t positions, texcoords, normals, faces, corners; };
+    std::vector<Offsets> base(chunkCount + 1);
+    base[0].positions = base[0].texcoords = base[0].normals = base[0].faces = base[0].corners = 0;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        base[i + 1].positions = base[i].positions + chunks[i].positions.size();
+        base[i + 1].texcoords = base[i].texcoords + chunks[i].texcoords.size();
+        base[i + 1].normals = base[i].normals + chunks[i].normals.size();
+        base[i + 1].faces = base[i].faces + chunks[i].faceCount();
+        base[i + 1].corners = base[i].corners + chunks[i].cornerCount();
+    }
+    const Offsets &total = base[chunkCount];
+    mesh.positions.resize(total.positions);
+    mesh.texcoords.resize(total.texcoords);
+    mesh.normals.resize(total.normals);
+    mesh.faceOffsets.resize(total.faces + 1);
+    mesh.cornerV.resize(total.corners);
+    mesh.cornerVT.resize(total.corners);
+    mesh.cornerVN.resize(total.corners);
+    mesh.faceOffsets[0] = 0;
+
+    // Scatter the chunks into place, again in parallel
+    nextChunk = 0;
+    auto mergeWorker = [&]() {
+        for (size_t i = nextChunk++; i < chunkCount; i = nextChunk++)
+        {
+            const ObjMeshData &c = chunks[i];
+            const Offsets &b = base[i];
+            std::copy(c.positions.begin(), c.positions.end(), mesh.positions.begin() + b.positions);
+            std::copy(c.texcoords.begin(), c.texcoords.end(), mesh.texcoords.begin() + b.texcoords);
+            std::copy(c.normals.begin(), c.normals.end(), mesh.normals.begin() + b.normals);
+            std::copy(c.cornerV.begin(), c.cornerV.end(), mesh.cornerV.begin() + b.corners);
+            std::copy(c.cornerVT.begin(), c.cornerVT.end(), mesh.cornerVT.begin() + b.corners);
+            std::copy(c.cornerVN.begin(), c.cornerVN.end(), mesh.cornerVN.begin() + b.corners);
+            for (size_t f = 1; f <= c.faceCount(); f++)
+                mesh.faceOffsets[b.faces + f] = (int)b.corners + c.faceOffsets[f];
+            // Relative indices count back from the chunk's own elements
+            for (size_t r = 0; r < c.relativeCorners.size(); r++)
+            {
+                size_t corner = b.corners + c.relativeCorners[r] / 3;
+                switch (c.relativeCorners[r] % 3)
+                {
+                case 0:
+                    mesh.cornerV[corner] += (int)(b.positions / 3);
+                    break;
+                case 1:
+                    mesh.cornerVT[corner] += (int)(b.texcoords / 2);
+                    break;
+                default:
+                    mesh.cornerVN[corner] += (int)(b.normals / 3);
+                    break;
+                }
+            }
+        }
+    };
+    workers.clear();
+    for (int t = 1; t < threadCount; t++)
+        workers.push_back(std::thread(mergeWorker));
+    mergeWorker();
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    // Names and runs: chunk-local name indices are mapped onto the merged
+    // tables. A chunk's leading faces simply continue the previous run.
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        const ObjMeshData &c = chunks[i];
+        for (size_t l = 0; l < c.materialLibraries.size(); l++)
+            objNameIndex(mesh.materialLibraries, c.materialLibraries[l]);
+        for (size_t n = 0; n < c.materialNames.size(); n++)
+            objNameIndex(mesh.materialNames, c.materialNames[n]);
+        for (size_t n = 0; n < c.groupNames.size(); n++)
+            objNameIndex(mesh.groupNames, c.groupNames[n]);
+        for (size_t r = 0; r < c.materialRuns.size(); r++)
+            objAddRun(mesh.materialRuns, (int)base[i].faces + c.materialRuns[r].firstFace,
+                      objNameIndex(mesh.materialNames, c.materialNames[c.materialRuns[r].index]));
+        for (size_t r = 0; r < c.groupRuns.size(); r++)
+            objAddRun(mesh.groupRuns, (int)base[i].faces + c.groupRuns[r].firstFace,
+                      objNameIndex(mesh.groupNames, c.groupNames[c.groupRuns[r].index]));
+    }
+    return threadCount;
+}
+
+// Map `filename` and parse it into `mesh`. Returns false if the file can't be opened.
+// threadCount > 1 enables the chunked parallel parser; 0 uses every hardware thread.
+inline bool objParseFile(const std::string &filename, ObjMeshData &mesh, ObjParseStats *stats = NULL, int threadCount = 1)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    MappedFile file(filename);
+    if (!file.isOpen())
+        return false;
+
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    mesh.clear();
+    threadCount = objParseBufferParallel(file.data(), file.data() + file.size(), mesh, threadCount);
+
+    if (stats != NULL)
+    {
+        stats->bytes = file.size();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats->threads = threadCount;
+    }
+    return true;
+}
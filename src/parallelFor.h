@@ -0,0 +1,40 @@
+#pragma once
+// parallelFor.h
+// Minimal fork/join helper for the load-time mesh passes.
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+inline int parallelThreadCount(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    return threadCount < 1 ? 1 : threadCount;
+}
+
+// Split [0, count) into one contiguous range per thread and call fn(begin, end)
+// on each. Ranges smaller than minBatch are not worth a thread, so small
+// inputs run inline on the caller.
+template <class Fn>
+void parallelFor(size_t count, int threadCount, size_t minBatch, Fn fn)
+{
+    threadCount = parallelThreadCount(threadCount);
+    if (minBatch < 1)
+        minBatch = 1;
+    size_t ranges = count / minBatch;
+    if (ranges > (size_t)threadCount)
+        ranges = threadCount;
+    if (ranges < 2)
+    {
+        if (count > 0)
+            fn((size_t)0, count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t r = 1; r < ranges; r++)
+        workers.push_back(std::thread(fn, count * r / ranges, count * (r + 1) / ranges));
+    fn((size_t)0, count / ranges);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
@@ -5,6 +5,10 @@
 #include "C:\OpenglLib\freeglut\include\GL\freeglut.h"
 #include "math3d.h"
 #include "objLoader.h"
+#include "grassField.h"
+#include "mipmaps.h"
+#include "textureLoader.h"
+#include <string.h>
 
 #ifndef _ORTHO_FRAME_
 #define _ORTHO_FRAME_
@@ -613,8 +617,10 @@ void drawTorso(GLfloat, GLfloat, GLfloat, int);
 bool timerStatus = true;
 void TimerFunction(int);
 
-// load obj file
-ObjLoader* grassObj = new ObjLoader("D:\\code\\graph\\Lab13\\final_sampleCode\\testOBJ.obj", "C:\\Users\\selab\\Downloads\\ImageToStl.com_nettle_plant_1k\\nettle_plant_dry_diff_1k_2.png");
+// load obj file (in the background, started from main once the window exists)
+ObjLoader* grassObj = NULL;
+GrassField* grassField = NULL;  // instanced copies of grassObj over the ground
+chrono::steady_clock::time_point startupTime;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Win32 Only
@@ -3109,12 +3115,76 @@ GLint gltWriteTGA(const char *szFileName)
     return 1;
 }
 
+////////////////////////////////////////////////////////////////////
+// Unpack RLE targa pixel data straight into GL's bottom-up rows. Pixels
+// arrive in file order; bTopDown files fill the rows from the last one
+// back, so no flip pass is needed. A packet is a count byte (high bit
+// set: one pixel repeated, else that many raw pixels) and may run across
+// rows. Returns false if the data ends early.
+static bool gltUnpackTGA(const unsigned char *pSrc, size_t nSrcBytes, bool bTopDown,
+                         int iWidth, int iHeight, int iBytes, unsigned char *pDst)
+{
+    const unsigned char *pEnd = pSrc + nSrcBytes;
+    size_t nRowBytes = (size_t)iWidth * iBytes;
+    int iRow = 0;       // rows finished, in file order
+    size_t nColumn = 0; // bytes written to the current row
+    unsigned char *pRow = pDst + (size_t)(bTopDown ? iHeight - 1 : 0) * nRowBytes;
+
+    while (iRow < iHeight)
+    {
+        if (pSrc >= pEnd)
+            return false;
+        bool bRun = (*pSrc & 0x80) != 0;
+        size_t nBytes = (size_t)((*pSrc & 0x7f) + 1) * iBytes;
+        pSrc++;
+        size_t nPacket = bRun ? iBytes : nBytes;
+        if ((size_t)(pEnd - pSrc) < nPacket)
+            return false;
+        const unsigned char *pPixel = pSrc;
+        pSrc += nPacket;
+
+        // Split the packet at row ends
+        while (nBytes > 0 && iRow < iHeight)
+        {
+            unsigned char *pOut = pRow + nColumn;
+            size_t nChunk = nBytes < nRowBytes - nColumn ? nBytes : nRowBytes - nColumn;
+            if (!bRun)
+            {
+                memcpy(pOut, pPixel, nChunk);
+                pPixel += nChunk;
+            }
+            else if (iBytes == 1)
+                memset(pOut, pPixel[0], nChunk);
+            else if (iBytes == 3)
+            {
+                for (size_t i = 0; i < nChunk; i += 3)
+                    memcpy(pOut + i, pPixel, 3);
+            }
+            else
+            {
+                for (size_t i = 0; i < nChunk; i += 4)
+                    memcpy(pOut + i, pPixel, 4);
+            }
+            nColumn += nChunk;
+            nBytes -= nChunk;
+            if (nColumn == nRowBytes)
+            {
+                nColumn = 0;
+                if (++iRow < iHeight)
+                    pRow = pDst + (size_t)(bTopDown ? iHeight - 1 - iRow : iRow) * nRowBytes;
+            }
+        }
+    }
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////
 // Allocate memory and load targa bits. Returns pointer to new buffer,
 // height, and width of texture, and the OpenGL format of data.
 // Call free() on buffer when finished!
-// This only works on pretty vanilla targas... 8, 24, or 32 bit color
-// only, no palettes, no RLE encoding.
+// Reads 8, 24, or 32 bit color, grey and 8 bit paletted targas, raw or
+// RLE encoded (types 1, 2, 3, 9, 10, 11), stored bottom-up or top-down.
+// Right-to-left files are read as left-to-right.
 GLbyte *gltLoadTGA(const char *szFileName, GLint *iWidth, GLint *iHeight, GLint *iComponents, GLenum *eFormat)
 {
     FILE *pFile;              // File pointer
@@ -3138,7 +3208,11 @@ GLbyte *gltLoadTGA(const char *szFileName, GLint *iWidth, GLint *iHeight, GLint
         return NULL;
     }
     // Read in header (binary)
-    fread(&tgaHeader, 18 /* sizeof(TGAHEADER)*/, 1, pFile);
+    if (fread(&tgaHeader, 18 /* sizeof(TGAHEADER)*/, 1, pFile) != 1)
+    {
+        fclose(pFile);
+        return NULL;
+    }
 
     // Do byte swap for big vs little endian
 #ifdef __APPLE__
@@ -3150,28 +3224,109 @@ GLbyte *gltLoadTGA(const char *szFileName, GLint *iWidth, GLint *iHeight, GLint
     LITTLE_ENDIAN_WORD(&tgaHeader.height);
 #endif
 
-    // Get width, height, and depth of texture
-    *iWidth = tgaHeader.width;
-    *iHeight = tgaHeader.height;
-    sDepth = tgaHeader.bits / 8;
+    int iType = tgaHeader.imageType & 7;
+    bool bRLE = (tgaHeader.imageType & 8) != 0;
+    bool bTopDown = (tgaHeader.descriptor & 0x20) != 0;
+    bool bPaletted = iType == 1;
+    int iPaletteBytes = (unsigned char)tgaHeader.colorMapBits / 8;
 
     // Put some validity checks here. Very simply, I only understand
-    // or care about 8, 24, or 32 bit targa's.
-    if (tgaHeader.bits != 8 && tgaHeader.bits != 24 && tgaHeader.bits != 32)
+    // or care about 8, 24, or 32 bit targa's, and 8 bit indices into a
+    // 24 or 32 bit palette.
+    if ((iType != 1 && iType != 2 && iType != 3) || (tgaHeader.imageType & ~15) != 0 ||
+        (tgaHeader.bits != 8 && tgaHeader.bits != 24 && tgaHeader.bits != 32) ||
+        (bPaletted && (tgaHeader.bits != 8 || tgaHeader.colorMapType != 1 || (iPaletteBytes != 3 && iPaletteBytes != 4))) ||
+        tgaHeader.width == 0 || tgaHeader.height == 0)
+    {
+        fclose(pFile);
         return NULL;
+    }
+
+    // Skip the ID field; keep the palette of paletted images
+    fseek(pFile, (unsigned char)tgaHeader.identsize, SEEK_CUR);
+    size_t nPaletteSize = tgaHeader.colorMapType == 1 ? (size_t)tgaHeader.colorMapLength * (((unsigned char)tgaHeader.colorMapBits + 7) / 8) : 0;
+    unsigned char *pPalette = NULL;
+    if (bPaletted)
+    {
+        pPalette = (unsigned char *)malloc(nPaletteSize);
+        if (pPalette == NULL || fread(pPalette, nPaletteSize, 1, pFile) != 1)
+        {
+            free(pPalette);
+            fclose(pFile);
+            return NULL;
+        }
+    }
+    else
+        fseek(pFile, (long)nPaletteSize, SEEK_CUR);
+
+    // Get width, height, and depth of texture
+    *iWidth = tgaHeader.width;
+    *iHeight = tgaHeader.height;
+    sDepth = bPaletted ? iPaletteBytes : tgaHeader.bits / 8;
+    int iFileDepth = tgaHeader.bits / 8;
 
     // Calculate size of image buffer
-    lImageSize = tgaHeader.width * tgaHeader.height * sDepth;
+    lImageSize = (unsigned long)tgaHeader.width * tgaHeader.height * sDepth;
 
     // Allocate memory and check for success
     pBits = (GLbyte *)malloc(lImageSize * sizeof(GLbyte));
-    if (pBits == NULL)
+    unsigned char *pIndices = bPaletted ? (unsigned char *)malloc((size_t)tgaHeader.width * tgaHeader.height) : NULL;
+    if (pBits == NULL || (bPaletted && pIndices == NULL))
+    {
+        free(pBits);
+        free(pIndices);
+        free(pPalette);
+        fclose(pFile);
         return NULL;
+    }
+    unsigned char *pDst = bPaletted ? pIndices : (unsigned char *)pBits;
+
+    // Read in the bits. Raw data is read straight into place, a top-down
+    // file one row at a time from the last row back; RLE data is read
+    // whole and unpacked from memory.
+    bool bOk;
+    size_t nRowBytes = (size_t)tgaHeader.width * iFileDepth;
+    if (!bRLE && !bTopDown)
+        bOk = fread(pDst, nRowBytes * tgaHeader.height, 1, pFile) == 1;
+    else if (!bRLE)
+    {
+        bOk = true;
+        for (int y = tgaHeader.height - 1; y >= 0 && bOk; y--)
+            bOk = fread(pDst + (size_t)y * nRowBytes, nRowBytes, 1, pFile) == 1;
+    }
+    else
+    {
+        long lStart = ftell(pFile);
+        fseek(pFile, 0, SEEK_END);
+        long lEnd = ftell(pFile);
+        fseek(pFile, lStart, SEEK_SET);
+        size_t nData = lEnd > lStart ? (size_t)(lEnd - lStart) : 0;
+        unsigned char *pData = (unsigned char *)malloc(nData > 0 ? nData : 1);
+        bOk = pData != NULL && fread(pData, nData, 1, pFile) == 1 &&
+              gltUnpackTGA(pData, nData, bTopDown, tgaHeader.width, tgaHeader.height, iFileDepth, pDst);
+        free(pData);
+    }
+
+    // Done with File
+    fclose(pFile);
 
-    // Read in the bits
-    // Check for read error. This should catch RLE or other
-    // weird formats that I don't want to recognize
-    if (fread(pBits, lImageSize, 1, pFile) != 1)
+    // Look the indices up in the palette
+    if (bOk && bPaletted)
+    {
+        size_t nPixels = (size_t)tgaHeader.width * tgaHeader.height;
+        unsigned char *pOut = (unsigned char *)pBits;
+        for (size_t i = 0; i < nPixels; i++, pOut += sDepth)
+        {
+            int iEntry = pIndices[i] - tgaHeader.colorMapStart;
+            if (iEntry < 0 || iEntry >= tgaHeader.colorMapLength)
+                memset(pOut, 0, sDepth);
+            else
+                memcpy(pOut, pPalette + (size_t)iEntry * sDepth, sDepth);
+        }
+    }
+    free(pIndices);
+    free(pPalette);
+    if (!bOk)
     {
         free(pBits);
         return NULL;
@@ -3194,9 +3349,6 @@ GLbyte *gltLoadTGA(const char *szFileName, GLint *iWidth, GLint *iHeight, GLint
         break;
     };
 
-    // Done with File
-    fclose(pFile);
-
     // Return pointer to image data
     return pBits;
 }
@@ -3257,6 +3409,7 @@ GLfloat angleBody = 0;
 // context.
 void SetupRC()
 {
+    std::chrono::steady_clock::time_point setupStart = std::chrono::steady_clock::now();
     M3DVector3f vPoints[3] = {{0.0f, -0.4f, 0.0f},
                               {10.0f, -0.4f, 0.0f},
                               {5.0f, -0.4f, -5.0f}};
@@ -3301,37 +3454,92 @@ void SetupRC()
     glMaterialfv(GL_FRONT, GL_SPECULAR, fBrightLight);
     glMateriali(GL_FRONT, GL_SHININESS, 128);
 
-    // Set up texture maps
+    // Set up texture maps through the shared cache, so a file an ObjLoader's
+    // materials also use is held on the GPU once
     glEnable(GL_TEXTURE_2D);
-    glGenTextures(NUM_TEXTURES, textureObjects);
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-    for (i = 0; i < NUM_TEXTURES; i++)
-    {
-        GLbyte *pBytes;
+    // Decode and build mips for every file on a pool of threads, and upload
+    // each here as soon as it is ready. Files already in the cache are only
+    // hashed. The cores are split between the distinct files, which are all
+    // decoded at once, for mipBuild's row bands.
+    std::vector<std::string> textureFiles =
+        TextureLoader::distinct(std::vector<std::string>(szTextureFiles, szTextureFiles + NUM_TEXTURES));
+    MipmapOptions mipOptions = mipOptionsForContext();
+    int mipThreads = parallelThreadCount(0) / (int)textureFiles.size();
+    mipOptions.threads = mipThreads > 1 ? mipThreads : 1;
+    ImageDecodeFn decodeTexture = [mipOptions](const std::string &path, DecodedImage &image) -> bool {
         GLint iWidth, iHeight, iComponents;
         GLenum eFormat;
+        image.pixels = (unsigned char *)gltLoadTGA(path.c_str(), &iWidth, &iHeight, &iComponents, &eFormat);
+        if (image.pixels == NULL)
+            return false;
+        image.width = iWidth;
+        image.height = iHeight;
+        image.channels = eFormat == GL_BGRA_EXT ? 4 : (eFormat == GL_LUMINANCE ? 1 : 3);
+        image.internalFormat = iComponents;
+        image.format = eFormat;
+        return mipBuild(image.pixels, iWidth, iHeight, image.channels, 0, mipOptions, image.mips);
+    };
+    TextureLoader loader;
+    loader.start(textureFiles, decodeTexture);
 
-        glBindTexture(GL_TEXTURE_2D, textureObjects[i]);
-
-        // Load this texture map
-        pBytes = gltLoadTGA(szTextureFiles[i], &iWidth, &iHeight, &iComponents, &eFormat);
-        gluBuild2DMipmaps(GL_TEXTURE_2D, iComponents, iWidth, iHeight, eFormat, GL_UNSIGNED_BYTE, pBytes);
-        free(pBytes);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    double slowestDecode = 0.0;
+    LoadedTexture loaded;
+    while (loader.next(loaded))
+    {
+        slowestDecode = loaded.decodeSeconds > slowestDecode ? loaded.decodeSeconds : slowestDecode;
+        for (i = 0; i < NUM_TEXTURES; i++)
+        {
+            if (loaded.path != szTextureFiles[i])
+                continue;
+            textureObjects[i] = 0;
+            if (loaded.resident || loaded.image)
+                textureObjects[i] = textureCache().acquire(loaded.path, loaded.hash, [&](GLuint) -> size_t {
+                    // A file found resident may have been released since;
+                    // decode it here then
+                    if (!loaded.image)
+                    {
+                        loaded.image.reset(new DecodedImage());
+                        if (!decodeTexture(loaded.path, *loaded.image))
+                        {
+                            loaded.image.reset();
+                            return 0;
+                        }
+                    }
+                    const DecodedImage &image = *loaded.image;
+                    mipUpload(image.mips, image.internalFormat, image.format);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                    return image.mips.bytes();
+                });
+            if (textureObjects[i] == 0)
+                printf("Could not load texture %s\n", szTextureFiles[i]);
+        }
+        loaded.image.reset();
     }
+    textureCache().dumpStats();
+    printf("SetupRC: %.1f ms, textures decoded on %d threads (slowest decode %.1f ms)\n",
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count(),
+           loader.threadCount(), slowestDecode * 1000.0);
 }
 
 ////////////////////////////////////////////////////////////////////////
 // Do shutdown for the rendering context
 void ShutdownRC(void)
 {
-    // Delete the textures
-    glDeleteTextures(NUM_TEXTURES, textureObjects);
+    // Release the textures
+    for (int i = 0; i < NUM_TEXTURES; i++)
+        textureCache().release(textureObjects[i]);
+    delete grassField;
+    grassField = NULL;
+    grassObj->releaseBuffers();
+    grassObj->releaseTexture();
+    textureCache().dumpStats();
+    delete grassObj;
+    grassObj = NULL;
 }
 
 ///////////////////////////////////////////////////////////
@@ -3626,6 +3834,11 @@ void DrawInhabitants(GLint nShadow)
     else
         glColor4f(0.00f, 0.00f, 0.00f, .6f); // Shadow color
 
+    // Grass field over the whole ground
+    glDisable(GL_CULL_FACE);
+    grassField->draw(nShadow);
+    glEnable(GL_CULL_FACE);
+
     glPushMatrix();
         glTranslatef(0.0f, 0.1f, -2.5f);
         glPushMatrix();
@@ -3766,6 +3979,26 @@ void RenderScene(void)
 
     // Do the buffer Swap
     glutSwapBuffers();
+    grassField->endFrame();
+
+    // Startup timing: first frame, then the first frame with the grass in it
+    static bool firstFrameDone = false, grassFrameDone = false;
+    if (!grassFrameDone)
+    {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - startupTime).count();
+        if (!firstFrameDone)
+        {
+            printf("Startup: first frame after %.1f ms\n", ms);
+            firstFrameDone = true;
+        }
+        if (grassObj->isReady())
+        {
+            printf("Startup: grass on screen after %.1f ms\n", ms);
+            grassFrameDone = true;
+        }
+        else
+            glutPostRedisplay(); // keep polling until the loader hands over
+    }
 }
 
 // Respond to arrow keys by moving the camera frame of reference
@@ -3949,6 +4182,7 @@ void drawRobotWithView(int nShadow)
 
 int main(int argc, char *argv[])
 {
+    startupTime = chrono::steady_clock::now();
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | GLUT_STENCIL);
     glutInitWindowSize(800, 600);
@@ -3957,6 +4191,17 @@ int main(int argc, char *argv[])
     glutDisplayFunc(RenderScene);
     glutSpecialFunc(SpecialKeys);
 
+    // Parse and decode on a worker while SetupRC and the first frames run
+    ObjLoadOptions grassOptions;
+    grassOptions.async = true;
+    // sphereworld --hot-reload: pick up edits to the plant without a restart,
+    // for artists iterating on the mesh
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--hot-reload") == 0)
+            grassOptions.hotReload = true;
+    grassObj = new ObjLoader("D:\\code\\graph\\Lab13\\final_sampleCode\\testOBJ.obj", "C:\\Users\\selab\\Downloads\\ImageToStl.com_nettle_plant_1k\\nettle_plant_dry_diff_1k_2.png", grassOptions);
+    grassField = new GrassField(grassObj, 20000, 20.0f, -0.4f, 0.2f, 0.5f);
+
     SetupRC();
     glutTimerFunc(33, TimerFunction, 1);
 
@@ -0,0 +1,169 @@
+#pragma once
+// textureCache.h
+// Process-wide cache of GL textures keyed by file path plus a hash of the
+// file contents. Every acquire() of the same (path, hash) returns the same
+// texture name and bumps its reference count; the texture is deleted when the
+// last reference is released. A changed file hashes differently and gets a
+// fresh texture, so stale images are never handed out.
+//
+// Decoding stays with the caller: on a miss the cache generates and binds a
+// texture name and calls the upload function, which decodes the file, sets
+// the texture parameters and uploads the levels. Callers sharing a path
+// therefore share the first uploader's sampler state.
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "glee.h"
+#include "contentHash.h"
+
+struct TextureCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t failures = 0;      // upload function returned 0
+    size_t entries = 0;       // live textures
+    size_t references = 0;    // outstanding acquire()s
+    size_t residentBytes = 0; // as reported by the upload functions
+};
+
+// Called with the new texture bound to GL_TEXTURE_2D; returns the bytes it
+// uploaded (including mip levels), or 0 if the file could not be decoded.
+typedef std::function<size_t(GLuint texture)> TextureUploadFn;
+
+class TextureCache
+{
+public:
+    static TextureCache &instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // Content hash as used for the key; false if the file can't be read
+    static bool hashFile(const std::string &path, uint64_t &hash) { return contentHashFile(path, hash); }
+
+    // Thread-safe; lets a loader thread skip decoding an image that is resident.
+    // Only a hint: the entry can be released before the caller acquires it.
+    bool contains(const std::string &path, uint64_t hash)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return find(path, hash) >= 0;
+    }
+
+    // GL thread only. Returns 0 if the file is missing or the upload failed.
+    GLuint acquire(const std::string &path, uint64_t hash, const TextureUploadFn &upload)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int index = find(path, hash);
+        if (index >= 0)
+        {
+            entries[index].references++;
+            counters.hits++;
+            return entries[index].texture;
+        }
+        counters.misses++;
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        size_t bytes = upload(texture);
+        if (bytes == 0)
+        {
+            glDeleteTextures(1, &texture);
+            counters.failures++;
+            return 0;
+        }
+        Entry entry;
+        entry.path = path;
+        entry.hash = hash;
+        entry.texture = texture;
+        entry.references = 1;
+        entry.bytes = bytes;
+        entries.push_back(entry);
+        return texture;
+    }
+    GLuint acquire(const std::string &path, const TextureUploadFn &upload)
+    {
+        uint64_t hash;
+        if (!hashFile(path, hash))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.failures++;
+            return 0;
+        }
+        return acquire(path, hash, upload);
+    }
+
+    // Drop one reference; the texture is deleted with the last one
+    void release(GLuint texture)
+    {
+        if (texture == 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].texture != texture)
+                continue;
+            if (--entries[i].references == 0)
+            {
+                glDeleteTextures(1, &entries[i].texture);
+                entries[i] = entries.back();
+                entries.pop_back();
+            }
+            return;
+        }
+    }
+
+    TextureCacheStats stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        TextureCacheStats result = counters;
+        result.entries = entries.size();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            result.references += entries[i].references;
+            result.residentBytes += entries[i].bytes;
+        }
+        return result;
+    }
+
+    void dumpStats(FILE *out = stdout)
+    {
+        TextureCacheStats s = stats();
+        fprintf(out, "TextureCache: %zu hits, %zu misses, %zu failed, %zu textures (%zu refs), %.2f MB resident\n",
+                s.hits, s.misses, s.failures, s.entries, s.references, s.residentBytes / (1024.0 * 1024.0));
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < entries.size(); i++)
+            fprintf(out, "  %u  x%u  %8.2f KB  %016llx  %s\n", entries[i].texture, entries[i].references,
+                    entries[i].bytes / 1024.0, (unsigned long long)entries[i].hash, entries[i].path.c_str());
+    }
+
+private:
+    struct Entry
+    {
+        std::string path;
+        uint64_t hash;
+        GLuint texture;
+        unsigned references;
+        size_t bytes;
+    };
+    std::mutex mutex;
+    std::vector<Entry> entries; // few textures; a linear scan beats a map here
+    TextureCacheStats counters;
+
+    TextureCache() {}
+    TextureCache(const TextureCache &);
+    TextureCache &operator=(const TextureCache &);
+
+    int find(const std::string &path, uint64_t hash) const
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+            if (entries[i].hash == hash && entries[i].path == path)
+                return (int)i;
+        return -1;
+    }
+};
+
+inline TextureCache &textureCache() { return TextureCache::instance(); }
@@ -0,0 +1,143 @@
+#pragma once
+// textureLoader.h
+// Startup texture loading in two stages. Files are decoded, and their mip
+// chains built, concurrently on a small pool of threads; the GL thread takes
+// each image as soon as it is ready, in completion order, and uploads it.
+// Files the TextureCache already holds are only hashed, not decoded; as the
+// entry can be released before the GL thread acquires it, the upload must
+// decode such a file itself on a miss.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mipmaps.h"
+#include "parallelFor.h"
+#include "textureCache.h"
+
+// A decoded file and its mip chain. The chain's base level may point into
+// `pixels`, so both live and die together.
+struct DecodedImage
+{
+    int width = 0, height = 0, channels = 0;
+    GLint internalFormat = GL_RGB8;
+    GLenum format = GL_BGR_EXT;
+    unsigned char *pixels = NULL; // malloc()ed by the decoder
+    MipChain mips;
+
+    DecodedImage() {}
+    DecodedImage(const DecodedImage &) = delete;
+    DecodedImage &operator=(const DecodedImage &) = delete;
+    ~DecodedImage() { free(pixels); }
+};
+
+// Runs on a pool thread: decode `path` into `image` and build its mips
+typedef std::function<bool(const std::string &path, DecodedImage &image)> ImageDecodeFn;
+
+struct LoadedTexture
+{
+    std::string path;
+    uint64_t hash = 0;
+    bool resident = false;              // in the TextureCache when checked: nothing decoded
+    std::unique_ptr<DecodedImage> image; // NULL if resident or the file could not be read
+    double decodeSeconds = 0.0;
+};
+
+class TextureLoader
+{
+public:
+    TextureLoader() {}
+    ~TextureLoader() { join(); }
+
+    // `paths` without repeats, in first-seen order: the files start() decodes
+    static std::vector<std::string> distinct(const std::vector<std::string> &paths)
+    {
+        std::vector<std::string> unique;
+        for (size_t i = 0; i < paths.size(); i++)
+            if (std::find(unique.begin(), unique.end(), paths[i]) == unique.end())
+                unique.push_back(paths[i]);
+        return unique;
+    }
+
+    // Decode every distinct path on up to `threads` threads (0: one per core)
+    void start(const std::vector<std::string> &paths, ImageDecodeFn decode, int threads = 0)
+    {
+        join();
+        pending = distinct(paths);
+        this->decode = decode;
+        nextPath = 0;
+        delivered = 0;
+        int workerCount = std::min(parallelThreadCount(threads), (int)pending.size());
+        for (int t = 0; t < workerCount; t++)
+            workers.push_back(std::thread([this]() { work(); }));
+    }
+
+    // Number of decode threads start() used
+    int threadCount() const { return (int)workers.size(); }
+
+    // GL thread: blocks until the next file is done. False once every file
+    // has been handed out.
+    bool next(LoadedTexture &texture)
+    {
+        if (delivered == pending.size())
+            return false;
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this]() { return !done.empty(); });
+        texture = std::move(done.front());
+        done.pop_front();
+        delivered++;
+        return true;
+    }
+
+private:
+    std::vector<std::string> pending; // distinct paths
+    ImageDecodeFn decode;
+    std::atomic<size_t> nextPath{0};
+    size_t delivered = 0;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<LoadedTexture> done;
+
+    void work()
+    {
+        for (;;)
+        {
+            size_t index = nextPath++;
+            if (index >= pending.size())
+                return;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            LoadedTexture texture;
+            texture.path = pending[index];
+            if (TextureCache::hashFile(texture.path, texture.hash))
+            {
+                texture.resident = TextureCache::instance().contains(texture.path, texture.hash);
+                if (!texture.resident)
+                {
+                    texture.image.reset(new DecodedImage());
+                    if (!decode(texture.path, *texture.image))
+                        texture.image.reset();
+                }
+            }
+            texture.decodeSeconds =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(mutex);
+            done.push_back(std::move(texture));
+            ready.notify_one();
+        }
+    }
+
+    void join()
+    {
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+};